@@ -9,11 +9,29 @@ CONFIG += c++17
 SOURCES += \
     main.cpp \
     mainwindow.cpp \
-    database.cpp
+    database.cpp \
+    columnstore.cpp \
+    aggregatekernels.cpp \
+    asyncdatabase.cpp \
+    readpool.cpp \
+    writequeue.cpp \
+    balanceverifier.cpp \
+    reportengine.cpp \
+    spendcube.cpp
 
 HEADERS += \
     mainwindow.h \
-    database.h
+    database.h \
+    columnstore.h \
+    aggregatekernels.h \
+    asyncdatabase.h \
+    readpool.h \
+    writequeue.h \
+    balanceverifier.h \
+    reportengine.h \
+    spendcube.h \
+    money.h \
+    rowschema.h
 
 FORMS += \
     mainwindow.ui
@@ -0,0 +1,183 @@
+#include "aggregatekernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define LEDGER_X86_KERNELS 1
+#include <immintrin.h>
+#else
+#define LEDGER_X86_KERNELS 0
+#endif
+
+namespace AggregateKernels {
+
+namespace {
+
+struct Grid {
+    const qint32 *keys;
+    qint32 keyBase;
+    const qint64 *edges;
+    int buckets;
+    qint64 *sums;
+    qint64 *counts;
+
+    void add(const Columns &columns, int row, qint64 bucket) const
+    {
+        const qint64 key = keys ? keys[row] - keyBase : 0;
+        const qint64 cell = key * buckets + bucket;
+        sums[cell] += columns.amounts[row];
+        ++counts[cell];
+    }
+};
+
+// Also finishes the rows a vector loop left over, from row first on.
+void sumScalar(const Columns &columns, quint8 type, const Grid &grid, int first)
+{
+    const qint64 from = grid.edges[0];
+    const qint64 to = grid.edges[grid.buckets];
+    for (int i = first; i < columns.rows; ++i) {
+        const qint64 time = columns.times[i];
+        if (columns.types[i] != type || time < from || time >= to) {
+            continue;
+        }
+        const qint64 *inner = grid.edges + 1;
+        grid.add(columns, i, std::upper_bound(inner, inner + grid.buckets - 1, time) - inner);
+    }
+}
+
+#if LEDGER_X86_KERNELS
+
+// The bucket of a matching row is buckets - 1 minus the inner edges above
+// its time; cmpgt yields -1 per such edge, so the masks are simply added.
+
+__attribute__((target("sse4.2")))
+int sumSse42(const Columns &columns, quint8 type, const Grid &grid)
+{
+    const __m128i wanted = _mm_set1_epi64x(type);
+    const __m128i from = _mm_set1_epi64x(grid.edges[0]);
+    const __m128i to = _mm_set1_epi64x(grid.edges[grid.buckets]);
+    const __m128i lastBucket = _mm_set1_epi64x(grid.buckets - 1);
+    int i = 0;
+    for (; i + 2 <= columns.rows; i += 2) {
+        const __m128i time = _mm_loadu_si128(reinterpret_cast<const __m128i *>(columns.times + i));
+        quint16 packed;
+        std::memcpy(&packed, columns.types + i, sizeof packed);
+        const __m128i kind = _mm_cvtepu8_epi64(_mm_cvtsi32_si128(packed));
+        __m128i match = _mm_andnot_si128(_mm_cmpgt_epi64(from, time), _mm_cmpgt_epi64(to, time));
+        match = _mm_and_si128(match, _mm_cmpeq_epi64(kind, wanted));
+        int lanes = _mm_movemask_pd(_mm_castsi128_pd(match));
+        if (!lanes) {
+            continue;
+        }
+        __m128i bucket = lastBucket;
+        for (int e = 1; e < grid.buckets; ++e) {
+            bucket = _mm_add_epi64(bucket, _mm_cmpgt_epi64(_mm_set1_epi64x(grid.edges[e]), time));
+        }
+        alignas(16) qint64 slot[2];
+        _mm_store_si128(reinterpret_cast<__m128i *>(slot), bucket);
+        while (lanes) {
+            const int lane = __builtin_ctz(unsigned(lanes));
+            lanes &= lanes - 1;
+            grid.add(columns, i + lane, slot[lane]);
+        }
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+int sumAvx2(const Columns &columns, quint8 type, const Grid &grid)
+{
+    const __m256i wanted = _mm256_set1_epi64x(type);
+    const __m256i from = _mm256_set1_epi64x(grid.edges[0]);
+    const __m256i to = _mm256_set1_epi64x(grid.edges[grid.buckets]);
+    const __m256i lastBucket = _mm256_set1_epi64x(grid.buckets - 1);
+    int i = 0;
+    for (; i + 4 <= columns.rows; i += 4) {
+        const __m256i time = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(columns.times + i));
+        quint32 packed;
+        std::memcpy(&packed, columns.types + i, sizeof packed);
+        const __m256i kind = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(int(packed)));
+        __m256i match = _mm256_andnot_si256(_mm256_cmpgt_epi64(from, time), _mm256_cmpgt_epi64(to, time));
+        match = _mm256_and_si256(match, _mm256_cmpeq_epi64(kind, wanted));
+        int lanes = _mm256_movemask_pd(_mm256_castsi256_pd(match));
+        if (!lanes) {
+            continue;
+        }
+        __m256i bucket = lastBucket;
+        for (int e = 1; e < grid.buckets; ++e) {
+            bucket = _mm256_add_epi64(bucket, _mm256_cmpgt_epi64(_mm256_set1_epi64x(grid.edges[e]), time));
+        }
+        alignas(32) qint64 slot[4];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(slot), bucket);
+        while (lanes) {
+            const int lane = __builtin_ctz(unsigned(lanes));
+            lanes &= lanes - 1;
+            grid.add(columns, i + lane, slot[lane]);
+        }
+    }
+    return i;
+}
+
+#endif // LEDGER_X86_KERNELS
+
+} // namespace
+
+Isa bestIsa()
+{
+#if LEDGER_X86_KERNELS
+    static const Isa best = []() {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return Isa::Avx2;
+        }
+        if (__builtin_cpu_supports("sse4.2")) {
+            return Isa::Sse42;
+        }
+        return Isa::Scalar;
+    }();
+    return best;
+#else
+    return Isa::Scalar;
+#endif
+}
+
+const char *isaName(Isa isa)
+{
+    switch (isa) {
+    case Isa::Avx2:
+        return "AVX2";
+    case Isa::Sse42:
+        return "SSE4.2";
+    case Isa::Scalar:
+        break;
+    }
+    return "scalar";
+}
+
+void sumByKeyAndTime(const Columns &columns, quint8 type, const qint32 *keys, qint32 keyBase,
+                     const qint64 *edges, int edgeCount, qint64 *sums, qint64 *counts, Isa isa)
+{
+    if (edgeCount < 2 || columns.rows <= 0) {
+        return;
+    }
+    const Grid grid{keys, keyBase, edges, edgeCount - 1, sums, counts};
+    int done = 0;
+#if LEDGER_X86_KERNELS
+    switch (std::min(isa, bestIsa())) {
+    case Isa::Avx2:
+        done = sumAvx2(columns, type, grid);
+        break;
+    case Isa::Sse42:
+        done = sumSse42(columns, type, grid);
+        break;
+    case Isa::Scalar:
+        break;
+    }
+#else
+    Q_UNUSED(isa);
+#endif
+    sumScalar(columns, type, grid, done);
+}
+
+} // namespace AggregateKernels
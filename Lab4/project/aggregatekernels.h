@@ -0,0 +1,44 @@
+#ifndef AGGREGATEKERNELS_H
+#define AGGREGATEKERNELS_H
+
+#include <QtGlobal>
+
+// Filter-and-sum loops over the column arrays of a ColumnStore. Each has a
+// scalar version and, on x86 built with GCC or Clang, SSE4.2 and AVX2
+// versions that test type and time range for several rows per
+// instruction. The best one the CPU supports is picked at run time.
+namespace AggregateKernels {
+
+// Ordered from least to most capable.
+enum class Isa {
+    Scalar,
+    Sse42,
+    Avx2,
+};
+
+// The most capable instruction set both this build and this CPU support.
+Isa bestIsa();
+const char *isaName(Isa isa);
+
+// Parallel arrays of rows rows each.
+struct Columns {
+    const qint64 *amounts;
+    const qint64 *times;
+    const quint8 *types;
+    int rows;
+};
+
+// Sums the amounts and counts the rows of the given type whose time lies
+// in [edges[0], edges[edgeCount - 1]) into a row-major grid of
+// edgeCount - 1 columns: row keys[i] - keyBase, column b for the bucket
+// [edges[b], edges[b + 1]) holding the time. A null keys puts every row in
+// grid row 0. edges must ascend, and the keys of matching rows must fall
+// inside the grid the caller allocated; sums and counts are added to, not
+// cleared. isa is lowered to bestIsa() if the CPU lacks it.
+void sumByKeyAndTime(const Columns &columns, quint8 type, const qint32 *keys, qint32 keyBase,
+                     const qint64 *edges, int edgeCount, qint64 *sums, qint64 *counts,
+                     Isa isa = bestIsa());
+
+} // namespace AggregateKernels
+
+#endif // AGGREGATEKERNELS_H
@@ -0,0 +1,168 @@
+#include "asyncdatabase.h"
+
+#include <limits>
+
+namespace {
+
+int kibibytes(qint64 bytes)
+{
+    return int(qMin<qint64>(bytes / 1024, std::numeric_limits<int>::max()));
+}
+
+// Runs on a backup thread, which opens and closes its own connection.
+bool backupLedger(const QString &source, const QString &target, QFutureInterface<bool> &promise)
+{
+    DatabaseOptions options;
+    options.readOnly = true;
+    options.idleCheckpointMs = 0;
+    Database reader;
+    if (!reader.init(source, options)) {
+        return false;
+    }
+    return reader.backupTo(target, [&promise](const BackupProgress &progress) {
+        promise.setProgressRange(0, kibibytes(progress.totalBytes));
+        promise.setProgressValue(kibibytes(progress.bytesCopied));
+    });
+}
+
+} // namespace
+
+AsyncDatabase::AsyncDatabase(QObject *parent)
+    : QObject(parent)
+    , worker(new Database)
+{
+    // The connection is created by init() on the worker thread and is only
+    // ever touched from there.
+    thread.setObjectName(QStringLiteral("LedgerDatabase"));
+    backups.setMaxThreadCount(1);
+    worker->moveToThread(&thread);
+    connect(&thread, &QThread::finished, worker, &QObject::deleteLater);
+    thread.start();
+}
+
+AsyncDatabase::~AsyncDatabase()
+{
+    // Queued behind every pending operation, so accepted writes still land
+    // before the connection closes.
+    QThread *workerThread = &thread;
+    QMetaObject::invokeMethod(worker, [workerThread]() { workerThread->quit(); }, Qt::QueuedConnection);
+    thread.wait();
+}
+
+QFuture<bool> AsyncDatabase::init(const DatabaseOptions &options)
+{
+    return run([options](Database &db) { return db.init(options); });
+}
+
+QFuture<bool> AsyncDatabase::init(const QString &dbFilePath, const DatabaseOptions &options)
+{
+    return run([dbFilePath, options](Database &db) { return db.init(dbFilePath, options); });
+}
+
+QFuture<int> AsyncDatabase::addTransaction(const Transaction &tx)
+{
+    return run([tx](Database &db) {
+        Transaction row = tx;
+        return db.addTransaction(row) ? row.id : -1;
+    });
+}
+
+QFuture<bool> AsyncDatabase::deleteTransaction(int id)
+{
+    return run([id](Database &db) { return db.deleteTransaction(id); });
+}
+
+QFuture<bool> AsyncDatabase::updateTransaction(const Transaction &tx)
+{
+    return run([tx](Database &db) { return db.updateTransaction(tx); });
+}
+
+QFuture<QList<Transaction>> AsyncDatabase::findTransactions(const TransactionQuery &query)
+{
+    return run([query](Database &db) { return db.findTransactions(query); });
+}
+
+QFuture<TransactionPage> AsyncDatabase::findTransactionsPage(const TransactionQuery &query,
+                                                             const TransactionCursor &cursor,
+                                                             int pageSize,
+                                                             PageDirection direction)
+{
+    return run([query, cursor, pageSize, direction](Database &db) {
+        return db.findTransactionsPage(query, cursor, pageSize, direction);
+    });
+}
+
+QFuture<int> AsyncDatabase::countTransactions(const TransactionQuery &query)
+{
+    return run([query](Database &db) { return db.countTransactions(query); });
+}
+
+QFuture<Money> AsyncDatabase::calculateSpent(int categoryId, int month)
+{
+    return run([categoryId, month](Database &db) { return db.calculateSpent(categoryId, month); });
+}
+
+QFuture<int> AsyncDatabase::addAccount(const Account &acc)
+{
+    return run([acc](Database &db) {
+        Account row = acc;
+        return db.addAccount(row) ? row.id : -1;
+    });
+}
+
+QFuture<QList<Account>> AsyncDatabase::getAllAccounts()
+{
+    return run([](Database &db) { return db.getAllAccounts(); });
+}
+
+QFuture<int> AsyncDatabase::addCategory(const Category &cat)
+{
+    return run([cat](Database &db) {
+        Category row = cat;
+        return db.addCategory(row) ? row.id : -1;
+    });
+}
+
+QFuture<QList<Category>> AsyncDatabase::getAllCategories(const QString &type)
+{
+    return run([type](Database &db) { return db.getAllCategories(type); });
+}
+
+QFuture<bool> AsyncDatabase::setBudget(const Budget &budget)
+{
+    return run([budget](Database &db) { return db.setBudget(budget); });
+}
+
+QFuture<Budget> AsyncDatabase::getBudget(int categoryId, int month)
+{
+    return run([categoryId, month](Database &db) { return db.getBudget(categoryId, month); });
+}
+
+QFuture<QList<BudgetReportRow>> AsyncDatabase::getBudgetReport(int month)
+{
+    return run([month](Database &db) { return db.getBudgetReport(month); });
+}
+
+QFuture<bool> AsyncDatabase::backupTo(const QString &path)
+{
+    QFutureInterface<bool> promise;
+    promise.reportStarted();
+    const QFuture<bool> future = promise.future();
+
+    // Queued like any operation, so earlier writes have committed, but the
+    // worker only looks up the file before handing the copy over.
+    Database *db = worker;
+    QThreadPool *pool = &backups;
+    QMetaObject::invokeMethod(worker, [promise, db, pool, path]() mutable {
+        if (promise.isCanceled()) {
+            promise.reportFinished();
+            return;
+        }
+        const QString source = db->filePath();
+        pool->start([promise, source, path]() mutable {
+            promise.reportResult(backupLedger(source, path, promise));
+            promise.reportFinished();
+        });
+    }, Qt::QueuedConnection);
+    return future;
+}
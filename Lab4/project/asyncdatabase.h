@@ -0,0 +1,111 @@
+#ifndef ASYNCDATABASE_H
+#define ASYNCDATABASE_H
+
+#include <QObject>
+#include <QThread>
+#include <QFuture>
+#include <QFutureInterface>
+#include <QFutureWatcher>
+#include <QThreadPool>
+#include <utility>
+
+#include "database.h"
+
+// Runs Database operations on a dedicated worker thread that owns its own
+// connection, so the calling thread never waits on SQLite. Every call
+// returns at once with a QFuture for its result.
+//
+// Operations run one at a time in submission order, so each caller sees
+// its own operations applied in the order it issued them. Cancelling a
+// future skips the operation if it has not started yet; one already
+// running completes normally. Destruction waits for queued operations.
+class AsyncDatabase : public QObject
+{
+    Q_OBJECT
+public:
+    explicit AsyncDatabase(QObject *parent = nullptr);
+    ~AsyncDatabase();
+
+    QFuture<bool> init(const DatabaseOptions &options = DatabaseOptions());
+    QFuture<bool> init(const QString &dbFilePath, const DatabaseOptions &options = DatabaseOptions());
+
+    // The add* calls resolve to the new row id, or -1 on failure.
+    QFuture<int> addTransaction(const Transaction &tx);
+    QFuture<bool> deleteTransaction(int id);
+    QFuture<bool> updateTransaction(const Transaction &tx);
+    QFuture<QList<Transaction>> findTransactions(const TransactionQuery &query);
+    QFuture<TransactionPage> findTransactionsPage(const TransactionQuery &query,
+                                                  const TransactionCursor &cursor,
+                                                  int pageSize,
+                                                  PageDirection direction = PageDirection::Forward);
+    QFuture<int> countTransactions(const TransactionQuery &query);
+    QFuture<Money> calculateSpent(int categoryId, int month);
+
+    QFuture<int> addAccount(const Account &acc);
+    QFuture<QList<Account>> getAllAccounts();
+    QFuture<int> addCategory(const Category &cat);
+    QFuture<QList<Category>> getAllCategories(const QString &type);
+
+    QFuture<bool> setBudget(const Budget &budget);
+    QFuture<Budget> getBudget(int categoryId, int month);
+    QFuture<QList<BudgetReportRow>> getBudgetReport(int month);
+
+    // Database::backupTo() on a read-only connection of its own, on a
+    // background thread: the copy holds every operation submitted before
+    // this call, and the ones after it run while the copy is written. The
+    // future reports progress in KiB.
+    QFuture<bool> backupTo(const QString &path);
+
+    // Queues job(Database &) on the worker thread; for composite reads that
+    // should run back to back, or operations without a wrapper above. The
+    // Database reference must not escape the job.
+    template <typename Job>
+    auto run(Job job) -> QFuture<decltype(job(std::declval<Database &>()))>;
+
+    // Calls handler(result) on context's thread once future finishes,
+    // unless it was cancelled or context has been destroyed by then.
+    template <typename T, typename Handler>
+    static void whenFinished(QObject *context, const QFuture<T> &future, Handler handler);
+
+private:
+    QThread thread;
+    Database *worker;
+    QThreadPool backups; // destroyed first, after waiting for running copies
+};
+
+template <typename Job>
+auto AsyncDatabase::run(Job job) -> QFuture<decltype(job(std::declval<Database &>()))>
+{
+    using Result = decltype(job(std::declval<Database &>()));
+
+    QFutureInterface<Result> promise;
+    promise.reportStarted();
+    const QFuture<Result> future = promise.future();
+
+    Database *db = worker;
+    // Queued calls to one receiver are delivered in the order they were
+    // posted, which is what keeps operations in submission order.
+    QMetaObject::invokeMethod(worker, [promise, db, job]() mutable {
+        if (!promise.isCanceled()) {
+            promise.reportResult(job(*db));
+        }
+        promise.reportFinished();
+    }, Qt::QueuedConnection);
+    return future;
+}
+
+template <typename T, typename Handler>
+void AsyncDatabase::whenFinished(QObject *context, const QFuture<T> &future, Handler handler)
+{
+    // Parented to context, so a destroyed context never sees the result.
+    auto *watcher = new QFutureWatcher<T>(context);
+    QObject::connect(watcher, &QFutureWatcher<T>::finished, context, [watcher, handler]() mutable {
+        if (!watcher->isCanceled()) {
+            handler(watcher->result());
+        }
+        watcher->deleteLater();
+    });
+    watcher->setFuture(future);
+}
+
+#endif // ASYNCDATABASE_H
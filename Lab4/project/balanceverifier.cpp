@@ -0,0 +1,67 @@
+#include "balanceverifier.h"
+
+#include "readpool.h"
+
+#include <QDebug>
+#include <QVector>
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+const int kRangesPerThread = 4;
+}
+
+BalanceVerifier::BalanceVerifier(ReadPool &pool, int threadCount)
+    : pool(pool)
+{
+    threads.setMaxThreadCount(qMax(threadCount, 1));
+}
+
+std::optional<QList<BalanceDrift>> BalanceVerifier::verify()
+{
+    Database *reader = pool.reader();
+    if (!reader) {
+        qCritical() << "Balance verification failed: no reader";
+        return std::nullopt;
+    }
+    QList<int> ids;
+    for (const Account &acc : reader->getAllAccounts()) {
+        ids.append(acc.id);
+    }
+    std::sort(ids.begin(), ids.end());
+    if (ids.isEmpty()) {
+        // Either there are no accounts or they could not be listed; one
+        // unsplit pass tells the two apart.
+        return reader->verifyBalances();
+    }
+
+    // Range i covers [bounds[i], bounds[i + 1]); the open last range also
+    // takes accounts created while the check runs.
+    const int rangeCount = qMin(ids.size(), threads.maxThreadCount() * kRangesPerThread);
+    QVector<int> bounds;
+    for (int i = 0; i < rangeCount; ++i) {
+        bounds.append(i == 0 ? 0 : ids.at(int(qint64(i) * ids.size() / rangeCount)));
+    }
+    bounds.append(std::numeric_limits<int>::max());
+
+    QVector<std::optional<QList<BalanceDrift>>> results(rangeCount);
+    for (int i = 0; i < rangeCount; ++i) {
+        threads.start([this, &bounds, &results, i]() {
+            if (Database *db = pool.reader()) {
+                results[i] = db->verifyBalances(bounds.at(i), bounds.at(i + 1));
+            }
+        });
+    }
+    threads.waitForDone();
+
+    QList<BalanceDrift> drift;
+    for (const std::optional<QList<BalanceDrift>> &range : results) {
+        if (!range) {
+            qCritical() << "Balance verification failed: a range could not be read";
+            return std::nullopt;
+        }
+        drift.append(*range);
+    }
+    return drift;
+}
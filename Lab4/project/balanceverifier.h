@@ -0,0 +1,35 @@
+#ifndef BALANCEVERIFIER_H
+#define BALANCEVERIFIER_H
+
+#include <QList>
+#include <QThread>
+#include <QThreadPool>
+
+#include <optional>
+
+#include "database.h"
+
+class ReadPool;
+
+// Checks every stored account balance against its opening balance plus
+// the transaction log, in parallel. The accounts are cut into id ranges
+// that run as separate jobs on a thread pool, each on that thread's
+// reader from pool. There are several ranges per thread, so one busy
+// account does not hold up the rest. Repair the result through the
+// writer with Database::repairBalances().
+class BalanceVerifier
+{
+public:
+    explicit BalanceVerifier(ReadPool &pool, int threadCount = QThread::idealThreadCount());
+
+    // Drifted accounts in id order; empty means every balance adds up.
+    // nullopt if any range could not be read, since a partial check
+    // proves nothing about the accounts it skipped.
+    std::optional<QList<BalanceDrift>> verify();
+
+private:
+    ReadPool &pool;
+    QThreadPool threads;
+};
+
+#endif // BALANCEVERIFIER_H
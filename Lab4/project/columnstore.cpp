@@ -0,0 +1,187 @@
+#include "columnstore.h"
+
+#include <algorithm>
+#include <vector>
+
+ColumnStore::TypeCode ColumnStore::typeCode(const QString &type)
+{
+    if (type == QStringLiteral("Income")) return Income;
+    if (type == QStringLiteral("Expense")) return Expense;
+    if (type == QStringLiteral("Transfer")) return Transfer;
+    return Other;
+}
+
+void ColumnStore::clear()
+{
+    ids.clear();
+    amounts.clear();
+    times.clear();
+    categoryIds.clear();
+    accountIds.clear();
+    months.clear();
+    types.clear();
+    noteIndex.clear();
+    notePool.clear();
+    noteLookup.clear();
+    maxCategoryId = 0;
+    minMonth = 0;
+    maxMonth = 0;
+}
+
+void ColumnStore::reserve(int rows)
+{
+    ids.reserve(rows);
+    amounts.reserve(rows);
+    times.reserve(rows);
+    categoryIds.reserve(rows);
+    accountIds.reserve(rows);
+    months.reserve(rows);
+    types.reserve(rows);
+    noteIndex.reserve(rows);
+}
+
+void ColumnStore::upsert(const Transaction &tx, int month)
+{
+    const int row = rowOf(tx.id);
+    if (row < ids.size() && ids.at(row) == tx.id) {
+        setRow(row, tx, month);
+        return;
+    }
+    // New ids come from AUTOINCREMENT, so this is an append unless the
+    // store was loaded out of order.
+    ids.insert(row, tx.id);
+    amounts.insert(row, 0);
+    times.insert(row, 0);
+    categoryIds.insert(row, 0);
+    accountIds.insert(row, 0);
+    months.insert(row, 0);
+    types.insert(row, Other);
+    noteIndex.insert(row, 0);
+    setRow(row, tx, month);
+}
+
+bool ColumnStore::remove(int id)
+{
+    const int row = rowOf(id);
+    if (row >= ids.size() || ids.at(row) != id) {
+        return false;
+    }
+    ids.remove(row);
+    amounts.remove(row);
+    times.remove(row);
+    categoryIds.remove(row);
+    accountIds.remove(row);
+    months.remove(row);
+    types.remove(row);
+    noteIndex.remove(row);
+    return true;
+}
+
+QMap<int, ColumnStore::Total> ColumnStore::totalsByCategory(TypeCode type, qint64 fromMs, qint64 toMs) const
+{
+    const qint64 edges[] = {fromMs, toMs};
+    std::vector<qint64> sums(size_t(maxCategoryId) + 1, 0);
+    std::vector<qint64> counts(sums.size(), 0);
+    AggregateKernels::sumByKeyAndTime(kernelColumns(), type, categoryIds.constData(), 0, edges, 2,
+                                      sums.data(), counts.data());
+
+    QMap<int, Total> totals;
+    for (size_t c = 0; c < counts.size(); ++c) {
+        if (counts[c] > 0) {
+            totals.insert(int(c), Total{Money::fromMinor(sums[c]), counts[c]});
+        }
+    }
+    return totals;
+}
+
+QMap<int, ColumnStore::Total> ColumnStore::totalsByMonth(TypeCode type, qint64 fromMs, qint64 toMs) const
+{
+    QMap<int, Total> totals;
+    if (ids.isEmpty()) {
+        return totals;
+    }
+    // Keyed on YYYYMM itself; the unused values between December and
+    // January only cost a few empty slots.
+    const qint64 edges[] = {fromMs, toMs};
+    std::vector<qint64> sums(size_t(maxMonth - minMonth) + 1, 0);
+    std::vector<qint64> counts(sums.size(), 0);
+    AggregateKernels::sumByKeyAndTime(kernelColumns(), type, months.constData(), minMonth, edges, 2,
+                                      sums.data(), counts.data());
+
+    for (size_t m = 0; m < counts.size(); ++m) {
+        if (counts[m] > 0) {
+            totals.insert(minMonth + int(m), Total{Money::fromMinor(sums[m]), counts[m]});
+        }
+    }
+    return totals;
+}
+
+QMap<int, QVector<ColumnStore::Total>> ColumnStore::monthlyTotalsByCategory(TypeCode type, int year,
+                                                                           AggregateKernels::Isa isa) const
+{
+    qint64 edges[13];
+    for (int m = 0; m < 13; ++m) {
+        edges[m] = QDateTime(QDate(year, 1, 1).addMonths(m), QTime(0, 0)).toMSecsSinceEpoch();
+    }
+    std::vector<qint64> sums((size_t(maxCategoryId) + 1) * 12, 0);
+    std::vector<qint64> counts(sums.size(), 0);
+    AggregateKernels::sumByKeyAndTime(kernelColumns(), type, categoryIds.constData(), 0, edges, 13,
+                                      sums.data(), counts.data(), isa);
+
+    QMap<int, QVector<Total>> totals;
+    for (int c = 0; c <= maxCategoryId; ++c) {
+        const size_t first = size_t(c) * 12;
+        if (std::all_of(counts.begin() + first, counts.begin() + first + 12, [](qint64 n) { return n == 0; })) {
+            continue;
+        }
+        QVector<Total> months(12);
+        for (int m = 0; m < 12; ++m) {
+            months[m] = Total{Money::fromMinor(sums[first + m]), counts[first + m]};
+        }
+        totals.insert(c, months);
+    }
+    return totals;
+}
+
+int ColumnStore::rowOf(int id) const
+{
+    return int(std::lower_bound(ids.constBegin(), ids.constEnd(), id) - ids.constBegin());
+}
+
+AggregateKernels::Columns ColumnStore::kernelColumns() const
+{
+    return AggregateKernels::Columns{amounts.constData(), times.constData(), types.constData(), ids.size()};
+}
+
+quint32 ColumnStore::internNote(const QString &note)
+{
+    const auto it = noteLookup.constFind(note);
+    if (it != noteLookup.constEnd()) {
+        return it.value();
+    }
+    const quint32 index = quint32(notePool.size());
+    notePool.append(note);
+    noteLookup.insert(note, index);
+    return index;
+}
+
+void ColumnStore::setRow(int row, const Transaction &tx, int month)
+{
+    // A row without a category is grouped as 0, as in the spend rollup.
+    const qint32 category = qMax(tx.categoryId, 0);
+    amounts[row] = tx.amount.minor();
+    times[row] = tx.time.toMSecsSinceEpoch();
+    categoryIds[row] = category;
+    accountIds[row] = tx.accountId;
+    months[row] = month;
+    types[row] = typeCode(tx.type);
+    noteIndex[row] = internNote(tx.note);
+
+    maxCategoryId = qMax(maxCategoryId, category);
+    if (ids.size() == 1 || month < minMonth) {
+        minMonth = month;
+    }
+    if (ids.size() == 1 || month > maxMonth) {
+        maxMonth = month;
+    }
+}
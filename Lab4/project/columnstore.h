@@ -0,0 +1,92 @@
+#ifndef COLUMNSTORE_H
+#define COLUMNSTORE_H
+
+#include <QHash>
+#include <QMap>
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+
+#include "aggregatekernels.h"
+#include "database.h"
+
+// The transactions table held column by column for analytics: one
+// contiguous array per column, rows in id order, notes interned in a
+// string pool. Aggregations walk the arrays directly instead of going
+// through SQLite and QVariant per row.
+//
+// Filled by Database::loadColumnStore() and kept current by that
+// Database's mutation methods once their writes commit.
+class ColumnStore
+{
+public:
+    enum TypeCode : quint8 {
+        Income,
+        Expense,
+        Transfer,
+        Other,
+    };
+    static TypeCode typeCode(const QString &type);
+
+    // Sum and row count of one group.
+    struct Total {
+        Money total;
+        qint64 count = 0;
+    };
+
+    void clear();
+    void reserve(int rows);
+    // Adds the row with tx.id, or replaces it if present. month is the
+    // stored YYYYMM bucket (see Database::calculateSpent()).
+    void upsert(const Transaction &tx, int month);
+    bool remove(int id);
+
+    int size() const { return ids.size(); }
+    // The pooled note of row (an index, not an id).
+    QString note(int row) const { return notePool.at(int(noteIndex.at(row))); }
+    int distinctNotes() const { return notePool.size(); }
+
+    // Rows of type with time in [fromMs, toMs), summed per category id
+    // (0 for rows without one) or per YYYYMM month.
+    QMap<int, Total> totalsByCategory(TypeCode type, qint64 fromMs, qint64 toMs) const;
+    QMap<int, Total> totalsByMonth(TypeCode type, qint64 fromMs, qint64 toMs) const;
+    // Twelve totals per category with rows of type in the given year,
+    // months taken from the local-time calendar, in a single pass.
+    QMap<int, QVector<Total>> monthlyTotalsByCategory(TypeCode type, int year,
+                                                      AggregateKernels::Isa isa = AggregateKernels::bestIsa()) const;
+
+    const QVector<qint32> &idColumn() const { return ids; }
+    const QVector<qint64> &amountColumn() const { return amounts; }
+    const QVector<qint64> &timeColumn() const { return times; }
+    const QVector<qint32> &categoryColumn() const { return categoryIds; }
+    const QVector<qint32> &accountColumn() const { return accountIds; }
+    const QVector<qint32> &monthColumn() const { return months; }
+    const QVector<quint8> &typeColumn() const { return types; }
+
+private:
+    int rowOf(int id) const;
+    AggregateKernels::Columns kernelColumns() const;
+    quint32 internNote(const QString &note);
+    void setRow(int row, const Transaction &tx, int month);
+
+    QVector<qint32> ids;
+    QVector<qint64> amounts;
+    QVector<qint64> times;
+    QVector<qint32> categoryIds;
+    QVector<qint32> accountIds;
+    QVector<qint32> months;
+    QVector<quint8> types;
+    QVector<quint32> noteIndex;
+
+    // Notes repeat (payees, "Salary"), so each distinct text is stored
+    // once. Texts no row refers to any more stay until the next load.
+    QVector<QString> notePool;
+    QHash<QString, quint32> noteLookup;
+
+    // Bounds of the group keys, so aggregations can use flat arrays.
+    qint32 maxCategoryId = 0;
+    qint32 minMonth = 0;
+    qint32 maxMonth = 0;
+};
+
+#endif // COLUMNSTORE_H
@@ -1,11 +1,23 @@
 #include "database.h"
+#include "columnstore.h"
+#include "rowschema.h"
+#include "spendcube.h"
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QVariant>
 #include <QDebug>
 #include <QDate>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
 #include <QUuid>
+#include <QStringList>
+#include <QMap>
+#include <algorithm>
+#include <limits>
+#include <tuple>
 
 namespace {
 enum class TxType {
@@ -22,27 +34,667 @@ TxType parseTxType(const QString &type) {
     return TxType::Unknown;
 }
 
-double balanceDeltaFor(TxType type, double amount) {
+Money balanceDeltaFor(TxType type, Money amount) {
     switch (type) {
     case TxType::Income:
         return amount;
     case TxType::Expense:
         return -amount;
     case TxType::Transfer:
-        return 0.0;
+        return Money();
     case TxType::Unknown:
-        return 0.0;
+        return Money();
     }
-    return 0.0;
+    return Money();
 }
+
+// LIKE pattern matching text literally; paired with ESCAPE '\' in the SQL.
+QString escapeLike(QString text)
+{
+    text.replace(QStringLiteral("\\"), QStringLiteral("\\\\"));
+    text.replace(QStringLiteral("%"), QStringLiteral("\\%"));
+    text.replace(QStringLiteral("_"), QStringLiteral("\\_"));
+    return text;
+}
+
+QString placeholders(int count)
+{
+    QStringList marks;
+    for (int i = 0; i < count; ++i) {
+        marks << QStringLiteral("?");
+    }
+    return marks.join(QStringLiteral(", "));
+}
+
+// A TransactionQuery lowered to SQL. shape identifies the statement text
+// independently of the bound values and is used as its cache key.
+struct CompiledQuery {
+    QString shape;
+    QString sql;
+    QVariantList binds;
+};
+
+// Appends the WHERE predicates of q (everything but order and limit).
+void appendTransactionFilter(const TransactionQuery &q, QStringList &where, CompiledQuery &compiled)
+{
+    if (q.from.isValid()) {
+        where << QStringLiteral("time >= ?");
+        compiled.binds << q.from.toMSecsSinceEpoch();
+        compiled.shape += QStringLiteral("f");
+    }
+    if (q.to.isValid()) {
+        where << QStringLiteral("time < ?");
+        compiled.binds << q.to.toMSecsSinceEpoch();
+        compiled.shape += QStringLiteral("t");
+    }
+    if (!q.accountIds.isEmpty()) {
+        where << QStringLiteral("accountId IN (%1)").arg(placeholders(q.accountIds.size()));
+        for (int id : q.accountIds) {
+            compiled.binds << id;
+        }
+        compiled.shape += QStringLiteral("a%1").arg(q.accountIds.size());
+    }
+    if (!q.categoryIds.isEmpty()) {
+        where << QStringLiteral("categoryId IN (%1)").arg(placeholders(q.categoryIds.size()));
+        for (int id : q.categoryIds) {
+            compiled.binds << id;
+        }
+        compiled.shape += QStringLiteral("c%1").arg(q.categoryIds.size());
+    }
+    if (!q.type.isEmpty()) {
+        where << QStringLiteral("type = ?");
+        compiled.binds << q.type;
+        compiled.shape += QStringLiteral("y");
+    }
+    if (q.minAmount) {
+        where << QStringLiteral("amount >= ?");
+        compiled.binds << q.minAmount->minor();
+        compiled.shape += QStringLiteral("m");
+    }
+    if (q.maxAmount) {
+        where << QStringLiteral("amount <= ?");
+        compiled.binds << q.maxAmount->minor();
+        compiled.shape += QStringLiteral("M");
+    }
+    if (!q.noteContains.isEmpty()) {
+        where << QStringLiteral("note LIKE ? ESCAPE '\\'");
+        compiled.binds << QStringLiteral("%") + escapeLike(q.noteContains) + QStringLiteral("%");
+        compiled.shape += QStringLiteral("n");
+    }
+    if (!q.notePrefix.isEmpty()) {
+        where << QStringLiteral("note LIKE ? ESCAPE '\\'");
+        compiled.binds << escapeLike(q.notePrefix) + QStringLiteral("%");
+        compiled.shape += QStringLiteral("p");
+    }
+}
+
+QString whereClause(const QStringList &where)
+{
+    return where.isEmpty() ? QString() : QStringLiteral(" WHERE ") + where.join(QStringLiteral(" AND "));
+}
+
+// SELECT of the rows matching q from source, in (time, id) order, whose
+// shape ends in sourceKey (see Database::transactionSource()). descending
+// flips the direction; keyset adds a "strictly beyond (time, id)" predicate
+// in that direction, bound to the two trailing values of the cursor.
+CompiledQuery compileTransactionSelect(const QString &source, const QString &sourceKey, const TransactionQuery &q,
+                                       bool descending, const TransactionCursor *keyset, int limit)
+{
+    CompiledQuery compiled;
+    QStringList where;
+    appendTransactionFilter(q, where, compiled);
+    if (keyset) {
+        // Row-value comparison: SQLite turns it into a range on the time
+        // index (which carries id as the rowid), unlike the OR spelling.
+        where << (descending ? QStringLiteral("(time, id) < (?, ?)") : QStringLiteral("(time, id) > (?, ?)"));
+        compiled.binds << keyset->time.toMSecsSinceEpoch() << keyset->id;
+        compiled.shape += QStringLiteral("k");
+    }
+
+    compiled.sql = QStringLiteral("SELECT ") + selectList<Transaction>() + QStringLiteral(" FROM ") + source
+            + whereClause(where);
+    // id breaks ties between rows with the same timestamp so the order is total.
+    if (descending) {
+        compiled.sql += QStringLiteral(" ORDER BY time DESC, id DESC");
+        compiled.shape += QStringLiteral(">");
+    } else {
+        compiled.sql += QStringLiteral(" ORDER BY time ASC, id ASC");
+        compiled.shape += QStringLiteral("<");
+    }
+    if (limit > 0) {
+        compiled.sql += QStringLiteral(" LIMIT ?");
+        compiled.binds << limit;
+        compiled.shape += QStringLiteral("l");
+    }
+    compiled.shape += sourceKey;
+    return compiled;
+}
+
+CompiledQuery compileTransactionCount(const QString &source, const QString &sourceKey, const TransactionQuery &q)
+{
+    CompiledQuery compiled;
+    QStringList where;
+    appendTransactionFilter(q, where, compiled);
+    compiled.sql = QStringLiteral("SELECT COUNT(*) FROM ") + source + whereClause(where);
+    compiled.shape += QStringLiteral("#") + sourceKey;
+    return compiled;
+}
+
+// The time range q can match, unbounded ends widened to the extremes.
+qint64 rangeStartMs(const TransactionQuery &q)
+{
+    return q.from.isValid() ? q.from.toMSecsSinceEpoch() : std::numeric_limits<qint64>::min();
+}
+
+qint64 rangeEndMs(const TransactionQuery &q)
+{
+    return q.to.isValid() ? q.to.toMSecsSinceEpoch() : std::numeric_limits<qint64>::max();
+}
+
+// Columns of the transactions table, in the order archives repeat them.
+const char *const kTransactionColumns = "id, amount, type, categoryId, accountId, time, month, note";
+
+// SQLite attaches at most 10 databases unless built otherwise; two are
+// left for callers of their own.
+const int kMaxAttachedPartitions = 8;
+
+// Room for every fixed statement plus the most used transaction query
+// shapes; filters and archive ranges can make the shapes unbounded.
+const int kMaxCachedStatements = 64;
+
+QString partitionSchema(int year)
+{
+    return QStringLiteral("archive_%1").arg(year);
+}
+
+// One archive file as the registry describes it: attached under the
+// schema of the earliest year it holds, and covering the time span from
+// that year to its latest.
+struct ArchiveFile {
+    QString fileName;
+    QString schema;
+    qint64 fromMs;
+    qint64 toMs;
+    int firstYear;
+    int lastYear;
+};
+
+// The distinct archive files of partitions (ordered by year), oldest first.
+QList<ArchiveFile> archiveFiles(const QList<ArchivePartition> &partitions)
+{
+    QList<ArchiveFile> files;
+    for (const ArchivePartition &partition : partitions) {
+        auto it = std::find_if(files.begin(), files.end(),
+                               [&partition](const ArchiveFile &file) { return file.fileName == partition.fileName; });
+        if (it == files.end()) {
+            files.append(ArchiveFile{partition.fileName, partitionSchema(partition.year),
+                                     partition.fromMs, partition.toMs, partition.year, partition.year});
+        } else {
+            it->fromMs = qMin(it->fromMs, partition.fromMs);
+            it->toMs = qMax(it->toMs, partition.toMs);
+            it->lastYear = partition.year;
+        }
+    }
+    return files;
+}
+
+// One file written by Database::backupTo(); sourcePath is empty for the
+// main file, which the backup connection opens directly.
+struct BackupFile {
+    QString schema;
+    QString sourcePath;
+    QString targetPath;
+};
+
+const unsigned long kBackupPollMs = 10;
+
+// Runs on the backup thread, on a connection of its own. VACUUM INTO reads
+// one snapshot and writes a compacted copy, so the copy is consistent
+// without holding any write lock.
+bool vacuumInto(const QString &databasePath, const QList<BackupFile> &files)
+{
+    const QString connectionName = QStringLiteral("backup_%1").arg(QUuid::createUuid().toString(QUuid::WithoutBraces));
+    bool ok = true;
+    {
+        QSqlDatabase connection = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+        connection.setDatabaseName(databasePath);
+        connection.setConnectOptions(QStringLiteral("QSQLITE_OPEN_READONLY"));
+        if (!connection.open()) {
+            qCritical() << "Failed to open backup connection:" << connection.lastError().text();
+            ok = false;
+        }
+        QSqlQuery query(connection);
+        for (const BackupFile &file : files) {
+            if (!ok) {
+                break;
+            }
+            if (!file.sourcePath.isEmpty()) {
+                query.prepare(QStringLiteral("ATTACH DATABASE :path AS %1").arg(file.schema));
+                query.bindValue(":path", file.sourcePath);
+                if (!query.exec()) {
+                    qCritical() << "Failed to attach archive for backup:" << query.lastError().text();
+                    ok = false;
+                    break;
+                }
+            }
+            query.prepare(QStringLiteral("VACUUM %1 INTO :target").arg(file.schema));
+            query.bindValue(":target", file.targetPath);
+            if (!query.exec()) {
+                qCritical() << "Failed to back up to" << file.targetPath << ":" << query.lastError().text();
+                ok = false;
+            }
+            if (!file.sourcePath.isEmpty() && !query.exec(QStringLiteral("DETACH DATABASE %1").arg(file.schema))) {
+                qWarning() << "Failed to detach archive after backup:" << query.lastError().text();
+            }
+        }
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+    return ok;
 }
 
-Database::Database(QObject *parent) : QObject(parent)
+qint64 totalFileSize(const QStringList &paths)
 {
+    qint64 total = 0;
+    for (const QString &path : paths) {
+        total += QFileInfo(path).size();
+    }
+    return total;
+}
+
+// YYYYMM of the local calendar date of tx.time, the bucket calculateSpent
+// and budgets are keyed on. Rows decode as local time, so a time passed in
+// as UTC or with an offset lands in the month it is later shown in.
+int monthOf(const QDateTime &time)
+{
+    const QDate date = time.toLocalTime().date();
+    return date.year() * 100 + date.month();
+}
+
+// The full row plus its stored month. Writes that undo an existing row
+// must debit the rollup cell it was credited to, and the decoded time may
+// fall in another month if the time zone has changed since it was written.
+QString selectTransactionForChangeSql()
+{
+    return QStringLiteral("SELECT ") + selectList<Transaction>()
+            + QStringLiteral(", month FROM transactions WHERE id = :id");
+}
+
+struct RollupKey {
+    int categoryId;
+    int month;
+    QString type;
+};
+
+bool operator<(const RollupKey &a, const RollupKey &b)
+{
+    return std::tie(a.categoryId, a.month, a.type) < std::tie(b.categoryId, b.month, b.type);
+}
+
+struct RollupDelta {
+    Money total;
+    qint64 count = 0;
+};
+
+// Balance of the accounts row named account, recomputed from its opening
+// balance, its rows (with the signs balanceDeltaFor() applies) and the
+// summed effect of its archived rows.
+QString expectedBalanceSql(const QString &account)
+{
+    return QStringLiteral(
+        "%1.openingBalance + IFNULL((SELECT SUM(CASE t.type WHEN 'Income' THEN t.amount "
+        "WHEN 'Expense' THEN -t.amount ELSE 0 END) FROM transactions t WHERE t.accountId = %1.id), 0) "
+        "+ IFNULL((SELECT delta FROM archived_balances WHERE accountId = %1.id), 0)")
+            .arg(account);
+}
+
+// Balance effect of one transactions row, as balanceDeltaFor() computes it.
+const char *const kBalanceDeltaSql =
+    "CASE type WHEN 'Income' THEN amount WHEN 'Expense' THEN -amount ELSE 0 END";
+
+struct BalanceCheckpoint {
+    qint64 startMs;
+    Money balance;
+};
+
+// Where refreshBalanceCheckpoints() picks an account up.
+struct CheckpointStart {
+    int accountId;
+    Money balance;
+    qint64 fromMs;
+};
+
+// Recomputes every rollup cell from source (see transactionSource()). A
+// NULL categoryId (only possible in hand-edited files) is bucketed as 0.
+QString recomputeRollupSql(const QString &source)
+{
+    return QStringLiteral("SELECT IFNULL(categoryId, 0), month, type, SUM(amount), COUNT(*) "
+                          "FROM %1 GROUP BY 1, 2, 3").arg(source);
+}
+
+// External-content FTS5 index over transactions.note. Triggers keep it in
+// step, so every write path maintains it without further code. Kept out of
+// schemaMigrations() because a SQLite built without FTS5 must still be able
+// to open the ledger. The drops let a rebuilt transactions table (which
+// loses its triggers) get a fresh index.
+const char *const kNoteIndexObjectsSql =
+    "SELECT COUNT(*) FROM sqlite_master WHERE name IN "
+    "('transactions_fts', 'transactions_fts_ai', 'transactions_fts_ad', 'transactions_fts_au')";
+const int kNoteIndexObjectCount = 4;
+
+const QStringList &noteIndexStatements()
+{
+    static const QStringList statements = {
+        "DROP TRIGGER IF EXISTS transactions_fts_ai",
+        "DROP TRIGGER IF EXISTS transactions_fts_ad",
+        "DROP TRIGGER IF EXISTS transactions_fts_au",
+        "DROP TABLE IF EXISTS transactions_fts",
+        // Prefix indexes on 2 and 3 characters keep short prefix queries
+        // from expanding over the whole term list.
+        "CREATE VIRTUAL TABLE transactions_fts USING fts5("
+        "note, content='transactions', content_rowid='id', "
+        "tokenize='unicode61 remove_diacritics 2', prefix='2 3')",
+        "CREATE TRIGGER transactions_fts_ai AFTER INSERT ON transactions BEGIN "
+        "INSERT INTO transactions_fts (rowid, note) VALUES (new.id, new.note); END",
+        "CREATE TRIGGER transactions_fts_ad AFTER DELETE ON transactions BEGIN "
+        "INSERT INTO transactions_fts (transactions_fts, rowid, note) VALUES ('delete', old.id, old.note); END",
+        "CREATE TRIGGER transactions_fts_au AFTER UPDATE OF note ON transactions BEGIN "
+        "INSERT INTO transactions_fts (transactions_fts, rowid, note) VALUES ('delete', old.id, old.note); "
+        "INSERT INTO transactions_fts (rowid, note) VALUES (new.id, new.note); END",
+        "INSERT INTO transactions_fts (transactions_fts) VALUES ('rebuild')",
+    };
+    return statements;
+}
+
+// FTS5 query requiring every word as a prefix. Each word is quoted, so
+// operators and punctuation in user input are matched literally.
+QString ftsPrefixQuery(const QStringList &words)
+{
+    QStringList terms;
+    for (QString word : words) {
+        word.replace(QStringLiteral("\""), QStringLiteral("\"\""));
+        terms << QStringLiteral("\"") + word + QStringLiteral("\"*");
+    }
+    return terms.join(QChar(' '));
+}
+
+// The note with every case-insensitive occurrence of words wrapped in
+// [ ], for the LIKE fallback of searchNotes().
+QString highlightWords(const QString &note, const QStringList &words)
+{
+    QString result;
+    int pos = 0;
+    while (pos < note.size()) {
+        int matched = 0;
+        for (const QString &word : words) {
+            if (note.mid(pos, word.size()).compare(word, Qt::CaseInsensitive) == 0) {
+                matched = qMax(matched, int(word.size()));
+            }
+        }
+        if (matched > 0) {
+            result += QChar('[') + note.mid(pos, matched) + QChar(']');
+            pos += matched;
+        } else {
+            result += note.at(pos++);
+        }
+    }
+    return result;
+}
+
+TransactionCursor cursorOf(const Transaction &tx)
+{
+    TransactionCursor cursor;
+    cursor.time = tx.time;
+    cursor.id = tx.id;
+    return cursor;
+}
+
+// One entry per schema version. PRAGMA user_version records the last version
+// applied, so released entries must never be edited or reordered: append a
+// new version instead. Version 1 is the original schema; IF NOT EXISTS lets
+// ledger.db files created before versioning (user_version 0) adopt it as-is.
+struct Migration {
+    int version;
+    QStringList statements;
+};
+
+QList<Migration> schemaMigrations()
+{
+    return {
+        {1, {
+            "CREATE TABLE IF NOT EXISTS transactions ("
+            "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+            "amount REAL NOT NULL, "
+            "type TEXT NOT NULL, "
+            "categoryId INTEGER, "
+            "accountId INTEGER NOT NULL, "
+            "time TEXT NOT NULL, "
+            "note TEXT)",
+            "CREATE TABLE IF NOT EXISTS accounts ("
+            "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+            "name TEXT NOT NULL UNIQUE, "
+            "type TEXT NOT NULL, "
+            "balance REAL NOT NULL DEFAULT 0)",
+            "CREATE TABLE IF NOT EXISTS categories ("
+            "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+            "name TEXT NOT NULL UNIQUE, "
+            "type TEXT NOT NULL)",
+            "CREATE TABLE IF NOT EXISTS budgets ("
+            "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+            "categoryId INTEGER NOT NULL, "
+            "month INTEGER NOT NULL, "
+            "limit_amount REAL NOT NULL, "
+            "UNIQUE(categoryId, month))",
+        }},
+        // Secondary indexes for the real access paths. amount is appended to
+        // the spend index so calculateSpent never has to visit the table.
+        {2, {
+            "CREATE INDEX IF NOT EXISTS idx_transactions_spend "
+            "ON transactions(type, categoryId, time, amount)",
+            "CREATE INDEX IF NOT EXISTS idx_transactions_account_time "
+            "ON transactions(accountId, time)",
+            "CREATE INDEX IF NOT EXISTS idx_transactions_time "
+            "ON transactions(time)",
+        }},
+        // time becomes epoch milliseconds and month its YYYYMM bucket. Old
+        // ISO strings without an offset were written in local time, which
+        // is what the 'utc' modifier assumes (it is a no-op for strings
+        // that carry an offset). month is taken from the text as written,
+        // matching the wall-clock comparison calculateSpent used to do.
+        // Unparseable values land at 0 rather than failing the upgrade.
+        {3, {
+            "CREATE TABLE transactions_v3 ("
+            "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+            "amount REAL NOT NULL, "
+            "type TEXT NOT NULL, "
+            "categoryId INTEGER, "
+            "accountId INTEGER NOT NULL, "
+            "time INTEGER NOT NULL, "
+            "month INTEGER NOT NULL, "
+            "note TEXT)",
+            "INSERT INTO transactions_v3 (id, amount, type, categoryId, accountId, time, month, note) "
+            "SELECT id, amount, type, categoryId, accountId, "
+            "COALESCE(CAST(ROUND((julianday(time, 'utc') - 2440587.5) * 86400000) AS INTEGER), 0), "
+            "CAST(substr(time, 1, 4) AS INTEGER) * 100 + CAST(substr(time, 6, 2) AS INTEGER), "
+            "note FROM transactions",
+            "DROP TABLE transactions",
+            "ALTER TABLE transactions_v3 RENAME TO transactions",
+            "CREATE INDEX idx_transactions_spend "
+            "ON transactions(type, categoryId, month, amount)",
+            "CREATE INDEX idx_transactions_account_time "
+            "ON transactions(accountId, time)",
+            "CREATE INDEX idx_transactions_time "
+            "ON transactions(time)",
+        }},
+        // Money columns become INTEGER minor units (see Money). SQLite's
+        // ROUND, like Money::fromDouble, rounds halves away from zero, which
+        // also absorbs drift that REAL balances have accumulated.
+        {4, {
+            "CREATE TABLE transactions_v4 ("
+            "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+            "amount INTEGER NOT NULL, "
+            "type TEXT NOT NULL, "
+            "categoryId INTEGER, "
+            "accountId INTEGER NOT NULL, "
+            "time INTEGER NOT NULL, "
+            "month INTEGER NOT NULL, "
+            "note TEXT)",
+            "INSERT INTO transactions_v4 (id, amount, type, categoryId, accountId, time, month, note) "
+            "SELECT id, CAST(ROUND(amount * 100) AS INTEGER), type, categoryId, accountId, time, month, note "
+            "FROM transactions",
+            "DROP TABLE transactions",
+            "ALTER TABLE transactions_v4 RENAME TO transactions",
+            "CREATE INDEX idx_transactions_spend "
+            "ON transactions(type, categoryId, month, amount)",
+            "CREATE INDEX idx_transactions_account_time "
+            "ON transactions(accountId, time)",
+            "CREATE INDEX idx_transactions_time "
+            "ON transactions(time)",
+            "CREATE TABLE accounts_v4 ("
+            "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+            "name TEXT NOT NULL UNIQUE, "
+            "type TEXT NOT NULL, "
+            "balance INTEGER NOT NULL DEFAULT 0)",
+            "INSERT INTO accounts_v4 (id, name, type, balance) "
+            "SELECT id, name, type, CAST(ROUND(balance * 100) AS INTEGER) FROM accounts",
+            "DROP TABLE accounts",
+            "ALTER TABLE accounts_v4 RENAME TO accounts",
+            "CREATE TABLE budgets_v4 ("
+            "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+            "categoryId INTEGER NOT NULL, "
+            "month INTEGER NOT NULL, "
+            "limit_amount INTEGER NOT NULL, "
+            "UNIQUE(categoryId, month))",
+            "INSERT INTO budgets_v4 (id, categoryId, month, limit_amount) "
+            "SELECT id, categoryId, month, CAST(ROUND(limit_amount * 100) AS INTEGER) FROM budgets",
+            "DROP TABLE budgets",
+            "ALTER TABLE budgets_v4 RENAME TO budgets",
+        }},
+        // Running total and row count per (category, month, type), kept in
+        // step with transactions by every write so calculateSpent is a
+        // primary key lookup.
+        {5, {
+            "CREATE TABLE spend_rollup ("
+            "categoryId INTEGER NOT NULL, "
+            "month INTEGER NOT NULL, "
+            "type TEXT NOT NULL, "
+            "total INTEGER NOT NULL DEFAULT 0, "
+            "count INTEGER NOT NULL DEFAULT 0, "
+            "PRIMARY KEY (categoryId, month, type)) WITHOUT ROWID",
+            "INSERT INTO spend_rollup (categoryId, month, type, total, count) "
+            "SELECT IFNULL(categoryId, 0), month, type, SUM(amount), COUNT(*) "
+            "FROM transactions GROUP BY 1, 2, 3",
+        }},
+        // Accounts remember what they were opened with, so a balance can be
+        // recomputed as opening balance plus the transaction log. Existing
+        // balances are taken as correct and the log is backed out of them.
+        // The account index gains type and amount so that summing one
+        // account's rows never leaves the index.
+        {6, {
+            "ALTER TABLE accounts ADD COLUMN openingBalance INTEGER NOT NULL DEFAULT 0",
+            "UPDATE accounts SET openingBalance = balance - IFNULL(("
+            "SELECT SUM(CASE transactions.type WHEN 'Income' THEN transactions.amount "
+            "WHEN 'Expense' THEN -transactions.amount ELSE 0 END) "
+            "FROM transactions WHERE transactions.accountId = accounts.id), 0)",
+            "DROP INDEX idx_transactions_account_time",
+            "CREATE INDEX idx_transactions_account_time "
+            "ON transactions(accountId, time, type, amount)",
+        }},
+        // Balance of each account from every row before startMs (a UTC
+        // month start), so historical balances sum at most a month of rows.
+        {7, {
+            "CREATE TABLE balance_checkpoints ("
+            "accountId INTEGER NOT NULL, "
+            "startMs INTEGER NOT NULL, "
+            "balance INTEGER NOT NULL, "
+            "PRIMARY KEY (accountId, startMs)) WITHOUT ROWID",
+        }},
+        // Registry of the per-year archive files, and each account's summed
+        // balance effect of its archived rows, so balances can still be
+        // verified without opening the archives.
+        {8, {
+            "CREATE TABLE partitions ("
+            "year INTEGER PRIMARY KEY, "
+            "fileName TEXT NOT NULL, "
+            "fromMs INTEGER NOT NULL, "
+            "toMs INTEGER NOT NULL, "
+            "rowCount INTEGER NOT NULL DEFAULT 0)",
+            "CREATE TABLE archived_balances ("
+            "accountId INTEGER PRIMARY KEY, "
+            "delta INTEGER NOT NULL DEFAULT 0, "
+            "count INTEGER NOT NULL DEFAULT 0)",
+        }},
+        // Months used to be taken in the time spec the caller passed, so a
+        // UTC time near a month boundary could be bucketed apart from the
+        // local month it displays in. Rows are moved to their local month,
+        // their rollup cells with them; archives are left as they are.
+        {9, {
+            "INSERT INTO spend_rollup (categoryId, month, type, total, count) "
+            "SELECT IFNULL(categoryId, 0), month, type, -SUM(amount), -COUNT(*) FROM transactions "
+            "WHERE month != CAST(strftime('%Y%m', time / 1000, 'unixepoch', 'localtime') AS INTEGER) "
+            "GROUP BY 1, 2, 3 "
+            "ON CONFLICT (categoryId, month, type) DO UPDATE SET "
+            "total = total + excluded.total, count = count + excluded.count",
+            "INSERT INTO spend_rollup (categoryId, month, type, total, count) "
+            "SELECT IFNULL(categoryId, 0), CAST(strftime('%Y%m', time / 1000, 'unixepoch', 'localtime') AS INTEGER), "
+            "type, SUM(amount), COUNT(*) FROM transactions "
+            "WHERE month != CAST(strftime('%Y%m', time / 1000, 'unixepoch', 'localtime') AS INTEGER) "
+            "GROUP BY 1, 2, 3 "
+            "ON CONFLICT (categoryId, month, type) DO UPDATE SET "
+            "total = total + excluded.total, count = count + excluded.count",
+            "UPDATE transactions SET month = CAST(strftime('%Y%m', time / 1000, 'unixepoch', 'localtime') AS INTEGER) "
+            "WHERE month != CAST(strftime('%Y%m', time / 1000, 'unixepoch', 'localtime') AS INTEGER)",
+        }},
+        // A counter that every committed change to the transactions bumps,
+        // so that copies built from them (a saved SpendCube) can tell
+        // whether they are still current.
+        {10, {
+            "CREATE TABLE ledger_state ("
+            "id INTEGER PRIMARY KEY CHECK (id = 1), "
+            "writeGeneration INTEGER NOT NULL)",
+            "INSERT INTO ledger_state (id, writeGeneration) VALUES (1, 0)",
+        }},
+    };
+}
+}
+
+DatabaseOptions DatabaseOptions::durable()
+{
+    DatabaseOptions options;
+    options.journalMode = QStringLiteral("DELETE");
+    return options;
+}
+
+DatabaseOptions DatabaseOptions::balanced()
+{
+    DatabaseOptions options;
+    options.journalMode = QStringLiteral("WAL");
+    options.synchronous = QStringLiteral("NORMAL");
+    options.cacheSizeKiB = 16 * 1024;
+    options.idleCheckpointMs = 2000;
+    return options;
+}
+
+DatabaseOptions DatabaseOptions::bulk()
+{
+    DatabaseOptions options = balanced();
+    options.cacheSizeKiB = 64 * 1024;
+    options.mmapSize = qint64(256) * 1024 * 1024;
+    options.tempStoreMemory = true;
+    options.idleCheckpointMs = 1000;
+    return options;
+}
+
+Database::Database(QObject *parent) : QObject(parent), checkpointTimer(this)
+{
+    statementCache.setMaxCost(kMaxCachedStatements);
+    // Parented so that moveToThread() takes the timer along.
+    checkpointTimer.setSingleShot(true);
+    connect(&checkpointTimer, &QTimer::timeout, this, &Database::checkpointWal);
 }
 
 Database::~Database()
 {
+    clearStatementCache();
     if (db.isOpen()) {
         db.close();
     }
@@ -58,422 +710,2313 @@ Database::~Database()
     }
 }
 
-bool Database::init()
+bool Database::init()
+{
+    return init(DatabaseOptions());
+}
+
+bool Database::init(const QString &dbFilePath)
+{
+    return init(dbFilePath, DatabaseOptions());
+}
+
+bool Database::init(const DatabaseOptions &options)
+{
+    const QString path = QDir::currentPath() + "/ledger.db";
+    return init(path, options);
+}
+
+QString Database::filePath() const
+{
+    return db.databaseName();
+}
+
+bool Database::init(const QString &dbFilePath, const DatabaseOptions &options)
+{
+    // Use a unique connection name per Database instance.
+    // If we used the default connection, multiple Database objects in a single
+    // process (like unit tests) would overwrite each other.
+    if (connectionName.isEmpty()) {
+        connectionName = QStringLiteral("ledger_%1").arg(QUuid::createUuid().toString(QUuid::WithoutBraces));
+    } else {
+        // Re-opening: statements prepared on the old connection are useless
+        // now, and the old handle must be released before the name is reused.
+        clearStatementCache();
+        invalidateEntityCaches();
+        partitions.clear();
+        attachedPartitions.clear();
+        columns.reset();
+        cube.reset();
+        checkpointTimer.stop();
+        if (db.isOpen()) {
+            db.close();
+        }
+        db = QSqlDatabase();
+        QSqlDatabase::removeDatabase(connectionName);
+    }
+
+    db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+
+    qDebug() << "Database path:" << dbFilePath;
+    db.setDatabaseName(dbFilePath);
+    if (options.readOnly) {
+        db.setConnectOptions(QStringLiteral("QSQLITE_OPEN_READONLY"));
+    }
+
+    if (!db.open()) {
+        qCritical() << "Database connection failed:" << db.lastError().text();
+        return false;
+    }
+
+    if (!applyOptions(options)) {
+        db.close();
+        return false;
+    }
+    if (options.readOnly) {
+        // A reader cannot migrate; the writer has to open the file first.
+        if (schemaVersion() != latestSchemaVersion()) {
+            qCritical() << "Read-only database is at schema version" << schemaVersion()
+                        << "but this build needs" << latestSchemaVersion();
+            db.close();
+            return false;
+        }
+        dataVersion = -1;
+        noteIndex = noteIndexComplete();
+    } else if (!migrateSchema()) {
+        db.close();
+        return false;
+    } else {
+        ensureNoteIndex();
+    }
+    if (!loadPartitions()) {
+        db.close();
+        return false;
+    }
+    // Ledgers archived before archive files were folded together may have
+    // more than can be attached; failing here only leaves full-range reads
+    // failing as they did.
+    if (!options.readOnly) {
+        consolidateArchives();
+    }
+    return true;
+}
+
+bool Database::applyOptions(const DatabaseOptions &requested)
+{
+    static const QStringList journalModes = {"DELETE", "TRUNCATE", "PERSIST", "MEMORY", "WAL", "OFF"};
+    static const QStringList syncModes = {"OFF", "NORMAL", "FULL", "EXTRA"};
+
+    // PRAGMA values cannot be bound, so only whitelisted keywords and
+    // numbers are ever formatted into the statements below.
+    const QString journalMode = requested.journalMode.toUpper();
+    const QString synchronous = requested.synchronous.toUpper();
+    if ((!journalMode.isEmpty() && !journalModes.contains(journalMode)) || !syncModes.contains(synchronous)) {
+        qCritical() << "Unsupported database options:" << requested.journalMode << requested.synchronous;
+        return false;
+    }
+
+    QSqlQuery query(db);
+    // journal_mode answers with the mode actually in effect; in-memory and
+    // some network file systems refuse WAL, which is not fatal. The journal
+    // mode is a property of the file and outlives the connection, so it is
+    // only set when asked for, and a reader leaves it to the writer.
+    if (!requested.readOnly && !journalMode.isEmpty()) {
+        if (!query.exec(QStringLiteral("PRAGMA journal_mode = %1").arg(journalMode)) || !query.next()) {
+            qCritical() << "Failed to set journal mode:" << query.lastError().text();
+            return false;
+        }
+        if (query.value(0).toString().toUpper() != journalMode) {
+            qWarning() << "Requested journal mode" << journalMode << "but got" << query.value(0).toString();
+        }
+        query.finish();
+    }
+
+    const QStringList pragmas = {
+        QStringLiteral("PRAGMA synchronous = %1").arg(synchronous),
+        QStringLiteral("PRAGMA cache_size = %1").arg(-qMax(requested.cacheSizeKiB, 1)),
+        QStringLiteral("PRAGMA mmap_size = %1").arg(qMax<qint64>(requested.mmapSize, 0)),
+        QStringLiteral("PRAGMA temp_store = %1").arg(requested.tempStoreMemory ? "MEMORY" : "DEFAULT"),
+    };
+    for (const QString &pragma : pragmas) {
+        if (!query.exec(pragma)) {
+            qCritical() << "Failed to apply" << pragma << ":" << query.lastError().text();
+            return false;
+        }
+        query.finish();
+    }
+
+    options = requested;
+    checkpointTimer.stop();
+    return true;
+}
+
+DatabaseOptions Database::activeOptions()
+{
+    DatabaseOptions active = options;
+    QSqlQuery query(db);
+
+    if (query.exec("PRAGMA journal_mode") && query.next()) {
+        active.journalMode = query.value(0).toString().toUpper();
+    }
+    if (query.exec("PRAGMA synchronous") && query.next()) {
+        static const QStringList syncModes = {"OFF", "NORMAL", "FULL", "EXTRA"};
+        active.synchronous = syncModes.value(query.value(0).toInt(), QStringLiteral("FULL"));
+    }
+    if (query.exec("PRAGMA cache_size") && query.next()) {
+        // Negative values are KiB, positive values are a page count.
+        const qint64 cacheSize = query.value(0).toLongLong();
+        if (cacheSize < 0) {
+            active.cacheSizeKiB = int(-cacheSize);
+        } else if (query.exec("PRAGMA page_size") && query.next()) {
+            active.cacheSizeKiB = int(cacheSize * query.value(0).toLongLong() / 1024);
+        }
+    }
+    if (query.exec("PRAGMA mmap_size") && query.next()) {
+        active.mmapSize = query.value(0).toLongLong();
+    }
+    if (query.exec("PRAGMA temp_store") && query.next()) {
+        active.tempStoreMemory = query.value(0).toInt() == 2;
+    }
+    return active;
+}
+
+void Database::scheduleIdleCheckpoint()
+{
+    // Restarted by every write, so the checkpoint runs only once writes stop.
+    if (options.idleCheckpointMs > 0 && options.journalMode.toUpper() == QStringLiteral("WAL")) {
+        checkpointTimer.start(options.idleCheckpointMs);
+    }
+}
+
+void Database::checkpointWal()
+{
+    if (!db.isOpen()) {
+        return;
+    }
+    QSqlQuery query(db);
+    // PASSIVE never waits on readers or writers; whatever it cannot copy now
+    // is picked up by the next idle period or by SQLite's auto-checkpoint.
+    if (!query.exec("PRAGMA wal_checkpoint(PASSIVE)")) {
+        qWarning() << "WAL checkpoint failed:" << query.lastError().text();
+    }
+}
+
+bool Database::migrateSchema()
+{
+    QSqlQuery query(db);
+    if (!query.exec("PRAGMA user_version") || !query.next()) {
+        qCritical() << "Failed to read schema version:" << query.lastError().text();
+        return false;
+    }
+    const int currentVersion = query.value(0).toInt();
+    query.finish();
+
+    const QList<Migration> migrations = schemaMigrations();
+    const int targetVersion = migrations.isEmpty() ? 0 : migrations.last().version;
+    if (currentVersion > targetVersion) {
+        qWarning() << "Database schema version" << currentVersion
+                   << "is newer than this build understands (" << targetVersion << ")";
+        return true;
+    }
+
+    for (const Migration &migration : migrations) {
+        if (migration.version <= currentVersion) {
+            continue;
+        }
+        clearStatementCache();
+
+        if (!db.transaction()) {
+            qCritical() << "Failed to start DB transaction:" << db.lastError().text();
+            return false;
+        }
+        for (const QString &statement : migration.statements) {
+            if (!query.exec(statement)) {
+                qCritical() << "Schema migration" << migration.version << "failed:" << query.lastError().text();
+                rollback();
+                return false;
+            }
+        }
+        // PRAGMA does not accept bound parameters; the version is our own constant.
+        if (!query.exec(QStringLiteral("PRAGMA user_version = %1").arg(migration.version))) {
+            qCritical() << "Failed to record schema version:" << query.lastError().text();
+            rollback();
+            return false;
+        }
+        if (!db.commit()) {
+            qCritical() << "Failed to commit schema migration:" << db.lastError().text();
+            rollback();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Database::noteIndexComplete()
+{
+    QSqlQuery query(db);
+    return query.exec(kNoteIndexObjectsSql) && query.next()
+            && query.value(0).toInt() == kNoteIndexObjectCount;
+}
+
+void Database::ensureNoteIndex()
+{
+    noteIndex = noteIndexComplete();
+    if (noteIndex) {
+        return;
+    }
+    if (!db.transaction()) {
+        qCritical() << "Failed to start DB transaction:" << db.lastError().text();
+        return;
+    }
+    QSqlQuery query(db);
+    for (const QString &statement : noteIndexStatements()) {
+        if (!query.exec(statement)) {
+            // Most likely SQLite was built without FTS5.
+            qWarning() << "Full-text note index unavailable, searchNotes() falls back to LIKE:"
+                       << query.lastError().text();
+            rollback();
+            return;
+        }
+    }
+    if (!db.commit()) {
+        qCritical() << "Failed to commit note index:" << db.lastError().text();
+        rollback();
+        return;
+    }
+    noteIndex = true;
+}
+
+bool Database::hasNoteIndex() const
+{
+    return noteIndex;
+}
+
+QList<NoteMatch> Database::searchNotes(const QString &terms, int limit)
+{
+    const QStringList words = terms.simplified().split(QChar(' '), Qt::SkipEmptyParts);
+    if (words.isEmpty() || limit <= 0) {
+        return {};
+    }
+    if (!noteIndex) {
+        return searchNotesByLike(words, limit);
+    }
+
+    QList<NoteMatch> matches;
+    // The inner query ranks and limits on the index alone; only the
+    // winners are joined back to their rows.
+    const QSharedPointer<QSqlQuery> query = cachedQuery(
+        QStringLiteral("notes.search"),
+        QStringLiteral("SELECT ") + selectList<Transaction>() + QStringLiteral(", m.snippet, m.score "
+        "FROM (SELECT rowid AS hit, snippet(transactions_fts, 0, '[', ']', '...', 12) AS snippet, "
+        "bm25(transactions_fts) AS score FROM transactions_fts "
+        "WHERE transactions_fts MATCH :terms ORDER BY rank LIMIT :limit) AS m "
+        "JOIN transactions ON transactions.id = m.hit ORDER BY m.score, id"));
+    if (!query) {
+        return matches;
+    }
+    query->bindValue(":terms", ftsPrefixQuery(words));
+    query->bindValue(":limit", limit);
+    if (!query->exec()) {
+        qCritical() << "Failed to search notes:" << query->lastError().text();
+        return matches;
+    }
+    const int snippetColumn = RowSchema<Transaction>::ColumnCount;
+    while (query->next()) {
+        matches.append(NoteMatch{decodeRow<Transaction>(*query),
+                                 query->value(snippetColumn).toString(),
+                                 query->value(snippetColumn + 1).toDouble()});
+    }
+    query->finish();
+    return matches;
+}
+
+QList<NoteMatch> Database::searchNotesByLike(const QStringList &words, int limit)
+{
+    QStringList where;
+    QVariantList binds;
+    for (const QString &word : words) {
+        where << QStringLiteral("note LIKE ? ESCAPE '\\'");
+        binds << QStringLiteral("%") + escapeLike(word) + QStringLiteral("%");
+    }
+    binds << limit;
+    const QString sql = selectFrom<Transaction>("transactions") + whereClause(where)
+            + QStringLiteral(" ORDER BY time DESC, id DESC LIMIT ?");
+
+    QList<NoteMatch> matches;
+    const QSharedPointer<QSqlQuery> query = execTransactionQuery(
+        QStringLiteral("notes%1").arg(words.size()), sql, binds);
+    if (!query) {
+        return matches;
+    }
+    while (query->next()) {
+        Transaction tx = decodeRow<Transaction>(*query);
+        const QString snippet = highlightWords(tx.note, words);
+        matches.append(NoteMatch{tx, snippet, 0.0});
+    }
+    query->finish();
+    return matches;
+}
+
+int Database::schemaVersion()
+{
+    QSqlQuery query(db);
+    if (query.exec("PRAGMA user_version") && query.next()) {
+        return query.value(0).toInt();
+    }
+    return -1;
+}
+
+int Database::latestSchemaVersion()
+{
+    const QList<Migration> migrations = schemaMigrations();
+    return migrations.isEmpty() ? 0 : migrations.last().version;
+}
+
+bool Database::addTransaction(Transaction &tx)
+{
+    const TxType txType = parseTxType(tx.type);
+    if (txType == TxType::Unknown) {
+        qCritical() << "Unsupported transaction type:" << tx.type;
+        return false;
+    }
+
+    if (!db.transaction()) {
+        qCritical() << "Failed to start DB transaction:" << db.lastError().text();
+        return false;
+    }
+
+    qint64 generation = 0;
+    if (!applyNewTransaction(tx) || !bumpWriteGeneration(generation)) {
+        rollback();
+        return false;
+    }
+
+    if (!db.commit()) {
+        qCritical() << "Failed to commit addTransaction:" << db.lastError().text();
+        rollback();
+        return false;
+    }
+    if (columns) {
+        columns->upsert(tx, monthOf(tx.time));
+    }
+    if (cube) {
+        cube->add(tx.categoryId, tx.accountId, tx.type, monthOf(tx.time), tx.amount, 1);
+        cube->followWrite(generation);
+    }
+    scheduleIdleCheckpoint();
+    return true;
+}
+
+bool Database::applyNewTransaction(Transaction &tx)
+{
+    // The balance goes last: once the cached balance is updated, nothing
+    // in here can fail any more.
+    return insertTransactionRow(tx)
+            && applySpendRollup(tx.categoryId, monthOf(tx.time), tx.type, tx.amount, 1)
+            && invalidateCheckpoints(tx.accountId, tx.time.toMSecsSinceEpoch())
+            && updateBalance(tx.accountId, balanceDeltaFor(parseTxType(tx.type), tx.amount));
+}
+
+bool Database::addTransactions(QList<Transaction> &txs)
+{
+    if (txs.isEmpty()) {
+        return true;
+    }
+    const auto fail = [&txs]() {
+        for (Transaction &tx : txs) {
+            tx.id = -1;
+        }
+        return false;
+    };
+    for (const Transaction &tx : txs) {
+        if (parseTxType(tx.type) == TxType::Unknown) {
+            qCritical() << "Unsupported transaction type:" << tx.type;
+            return fail();
+        }
+    }
+
+    if (!db.transaction()) {
+        qCritical() << "Failed to start DB transaction:" << db.lastError().text();
+        return fail();
+    }
+
+    // Balance deltas are summed per account so each touched account costs a
+    // single UPDATE, however many rows the batch holds. Accounts whose net
+    // delta is zero are still updated: that is what rejects unknown ids.
+    // Rollup cells are summed the same way.
+    QMap<int, Money> deltas;
+    QMap<RollupKey, RollupDelta> rollups;
+    QMap<int, qint64> earliest;
+    bool ok = true;
+    for (Transaction &tx : txs) {
+        if (!insertTransactionRow(tx)) {
+            ok = false;
+            break;
+        }
+        deltas[tx.accountId] += balanceDeltaFor(parseTxType(tx.type), tx.amount);
+        const qint64 timeMs = tx.time.toMSecsSinceEpoch();
+        const auto first = earliest.find(tx.accountId);
+        if (first == earliest.end()) {
+            earliest.insert(tx.accountId, timeMs);
+        } else {
+            *first = qMin(*first, timeMs);
+        }
+        RollupDelta &cell = rollups[RollupKey{tx.categoryId, monthOf(tx.time), tx.type}];
+        cell.total += tx.amount;
+        ++cell.count;
+    }
+    for (auto it = earliest.constBegin(); ok && it != earliest.constEnd(); ++it) {
+        ok = invalidateCheckpoints(it.key(), it.value());
+    }
+    for (auto it = deltas.constBegin(); ok && it != deltas.constEnd(); ++it) {
+        ok = updateBalance(it.key(), it.value());
+    }
+    for (auto it = rollups.constBegin(); ok && it != rollups.constEnd(); ++it) {
+        ok = applySpendRollup(it.key().categoryId, it.key().month, it.key().type,
+                              it.value().total, it.value().count);
+    }
+    qint64 generation = 0;
+    ok = ok && bumpWriteGeneration(generation);
+
+    if (ok && !db.commit()) {
+        qCritical() << "Failed to commit addTransactions:" << db.lastError().text();
+        ok = false;
+    }
+    if (!ok) {
+        rollback();
+        return fail();
+    }
+    if (columns) {
+        columns->reserve(columns->size() + txs.size());
+        for (const Transaction &tx : txs) {
+            columns->upsert(tx, monthOf(tx.time));
+        }
+    }
+    for (int i = 0; cube && i < txs.size(); ++i) {
+        cube->add(txs[i].categoryId, txs[i].accountId, txs[i].type, monthOf(txs[i].time), txs[i].amount, 1);
+    }
+    if (cube) {
+        cube->followWrite(generation);
+    }
+    scheduleIdleCheckpoint();
+    return true;
+}
+
+bool Database::addTransactionGroup(QList<Transaction> &txs, QVector<bool> &applied)
+{
+    applied.fill(false, txs.size());
+    if (txs.isEmpty()) {
+        return true;
+    }
+    if (!db.transaction()) {
+        qCritical() << "Failed to start DB transaction:" << db.lastError().text();
+        return false;
+    }
+
+    const auto abandon = [&]() {
+        rollback();
+        for (Transaction &tx : txs) {
+            tx.id = -1;
+        }
+        applied.fill(false);
+        return false;
+    };
+
+    // A savepoint per element undoes a failed one without touching the
+    // rest of the batch.
+    QSqlQuery savepoint(db);
+    for (int i = 0; i < txs.size(); ++i) {
+        Transaction &tx = txs[i];
+        if (parseTxType(tx.type) == TxType::Unknown) {
+            qCritical() << "Unsupported transaction type:" << tx.type;
+            tx.id = -1;
+            continue;
+        }
+        if (!savepoint.exec("SAVEPOINT group_item")) {
+            qCritical() << "Failed to open savepoint:" << savepoint.lastError().text();
+            return abandon();
+        }
+        applied[i] = applyNewTransaction(tx);
+        if (!applied[i]) {
+            tx.id = -1;
+            if (!savepoint.exec("ROLLBACK TO group_item")) {
+                qCritical() << "Failed to roll back savepoint:" << savepoint.lastError().text();
+                return abandon();
+            }
+        }
+        if (!savepoint.exec("RELEASE group_item")) {
+            qCritical() << "Failed to release savepoint:" << savepoint.lastError().text();
+            return abandon();
+        }
+    }
+
+    qint64 generation = 0;
+    if (!bumpWriteGeneration(generation)) {
+        return abandon();
+    }
+    if (!db.commit()) {
+        qCritical() << "Failed to commit addTransactionGroup:" << db.lastError().text();
+        return abandon();
+    }
+    for (int i = 0; columns && i < txs.size(); ++i) {
+        if (applied[i]) {
+            columns->upsert(txs[i], monthOf(txs[i].time));
+        }
+    }
+    for (int i = 0; cube && i < txs.size(); ++i) {
+        if (applied[i]) {
+            cube->add(txs[i].categoryId, txs[i].accountId, txs[i].type, monthOf(txs[i].time), txs[i].amount, 1);
+        }
+    }
+    if (cube) {
+        cube->followWrite(generation);
+    }
+    scheduleIdleCheckpoint();
+    return true;
+}
+
+bool Database::insertTransactionRow(Transaction &tx)
+{
+    const QSharedPointer<QSqlQuery> query = cachedQuery(
+        QStringLiteral("transactions.insert"),
+        "INSERT INTO transactions (amount, type, categoryId, accountId, time, month, note) "
+        "VALUES (:amount, :type, :categoryId, :accountId, :time, :month, :note)");
+    if (!query) {
+        return false;
+    }
+    query->bindValue(":amount", tx.amount.minor());
+    query->bindValue(":type", tx.type);
+    query->bindValue(":categoryId", tx.categoryId);
+    query->bindValue(":accountId", tx.accountId);
+    query->bindValue(":time", tx.time.toMSecsSinceEpoch());
+    query->bindValue(":month", monthOf(tx.time));
+    query->bindValue(":note", tx.note);
+
+    if (!query->exec()) {
+        qCritical() << "Failed to add transaction:" << query->lastError().text();
+        return false;
+    }
+    tx.id = query->lastInsertId().toInt();
+    return true;
+}
+
+bool Database::applySpendRollup(int categoryId, int month, const QString &type, Money total, qint64 count)
+{
+    // Cells whose count drops to zero are kept; they read as zero spend.
+    const QSharedPointer<QSqlQuery> query = cachedQuery(
+        QStringLiteral("spendRollup.apply"),
+        "INSERT INTO spend_rollup (categoryId, month, type, total, count) "
+        "VALUES (:categoryId, :month, :type, :total, :count) "
+        "ON CONFLICT (categoryId, month, type) DO UPDATE SET "
+        "total = total + excluded.total, count = count + excluded.count");
+    if (!query) {
+        return false;
+    }
+    query->bindValue(":categoryId", categoryId);
+    query->bindValue(":month", month);
+    query->bindValue(":type", type);
+    query->bindValue(":total", total.minor());
+    query->bindValue(":count", count);
+    if (!query->exec()) {
+        qCritical() << "Failed to update spend rollup:" << query->lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool Database::deleteTransaction(int id)
+{
+    if (!db.transaction()) {
+        qCritical() << "Failed to start DB transaction:" << db.lastError().text();
+        return false;
+    }
+    const QSharedPointer<QSqlQuery> selectQuery = cachedQuery(
+        QStringLiteral("transactions.selectForChange"),
+        selectTransactionForChangeSql());
+    if (!selectQuery) {
+        rollback();
+        return false;
+    }
+    selectQuery->bindValue(":id", id);
+    if (!selectQuery->exec() || !selectQuery->next()) {
+        qCritical() << "Failed to retrieve transaction for deletion:" << selectQuery->lastError().text();
+        rollback();
+        return false;
+    }
+
+    const Transaction old = decodeRow<Transaction>(*selectQuery);
+    const int oldMonth = selectQuery->value(RowSchema<Transaction>::ColumnCount).toInt();
+    selectQuery->finish();
+    const Money amount = old.amount;
+    const QString type = old.type;
+    const int accountId = old.accountId;
+
+    const TxType txType = parseTxType(type);
+    if (txType == TxType::Unknown) {
+        qCritical() << "Unsupported transaction type:" << type;
+        rollback();
+        return false;
+    }
+
+    const QSharedPointer<QSqlQuery> deleteQuery = cachedQuery(
+        QStringLiteral("transactions.delete"),
+        "DELETE FROM transactions WHERE id = :id");
+    if (!deleteQuery) {
+        rollback();
+        return false;
+    }
+    deleteQuery->bindValue(":id", id);
+
+    if (deleteQuery->exec() && deleteQuery->numRowsAffected() == 1) {
+        const Money deltaApplied = balanceDeltaFor(txType, amount);
+        qint64 generation = 0;
+        if (updateBalance(accountId, -deltaApplied)
+                && applySpendRollup(old.categoryId, oldMonth, type, -amount, -1)
+                && invalidateCheckpoints(accountId, old.time.toMSecsSinceEpoch())
+                && bumpWriteGeneration(generation)) {
+            if (!db.commit()) {
+                qCritical() << "Failed to commit deleteTransaction:" << db.lastError().text();
+                rollback();
+                return false;
+            }
+            if (columns) {
+                columns->remove(id);
+            }
+            if (cube) {
+                cube->add(old.categoryId, accountId, type, oldMonth, -amount, -1);
+                cube->followWrite(generation);
+            }
+            scheduleIdleCheckpoint();
+            return true;
+        }
+    }
+    
+    qCritical() << "Failed to delete transaction:" << deleteQuery->lastError().text();
+    rollback();
+    return false;
+}
+
+bool Database::updateTransaction(const Transaction &tx)
+{
+    if (!db.transaction()) {
+        qCritical() << "Failed to start DB transaction:" << db.lastError().text();
+        return false;
+    }
+
+    const QSharedPointer<QSqlQuery> oldQuery = cachedQuery(
+        QStringLiteral("transactions.selectForChange"),
+        selectTransactionForChangeSql());
+    if (!oldQuery) {
+        rollback();
+        return false;
+    }
+    oldQuery->bindValue(":id", tx.id);
+    if (!oldQuery->exec() || !oldQuery->next()) {
+        qCritical() << "Failed to retrieve old transaction:" << oldQuery->lastError().text();
+        rollback();
+        return false;
+    }
+
+    const Transaction old = decodeRow<Transaction>(*oldQuery);
+    const int oldMonth = oldQuery->value(RowSchema<Transaction>::ColumnCount).toInt();
+    oldQuery->finish();
+    const Money oldAmount = old.amount;
+    const QString oldTypeStr = old.type;
+    const int oldAccountId = old.accountId;
+
+    const TxType oldType = parseTxType(oldTypeStr);
+    const TxType newType = parseTxType(tx.type);
+    if (oldType == TxType::Unknown || newType == TxType::Unknown) {
+        qCritical() << "Unsupported transaction type:" << oldTypeStr << tx.type;
+        rollback();
+        return false;
+    }
+
+    const Money oldDelta = balanceDeltaFor(oldType, oldAmount);
+    const Money newDelta = balanceDeltaFor(newType, tx.amount);
+
+    const QSharedPointer<QSqlQuery> query = cachedQuery(
+        QStringLiteral("transactions.update"),
+        "UPDATE transactions SET amount = :amount, type = :type, categoryId = :categoryId, "
+        "accountId = :accountId, time = :time, month = :month, note = :note WHERE id = :id");
+    if (!query) {
+        rollback();
+        return false;
+    }
+    query->bindValue(":amount", tx.amount.minor());
+    query->bindValue(":type", tx.type);
+    query->bindValue(":categoryId", tx.categoryId);
+    query->bindValue(":accountId", tx.accountId);
+    query->bindValue(":time", tx.time.toMSecsSinceEpoch());
+    query->bindValue(":month", monthOf(tx.time));
+    query->bindValue(":note", tx.note);
+    query->bindValue(":id", tx.id);
+
+    if (!query->exec() || query->numRowsAffected() != 1) {
+        qCritical() << "Failed to update transaction:" << query->lastError().text();
+        rollback();
+        return false;
+    }
+
+    if (!invalidateCheckpoints(oldAccountId, old.time.toMSecsSinceEpoch())
+            || !invalidateCheckpoints(tx.accountId, tx.time.toMSecsSinceEpoch())) {
+        rollback();
+        return false;
+    }
+
+    if (tx.accountId == oldAccountId) {
+        if (!updateBalance(oldAccountId, newDelta - oldDelta)) {
+            rollback();
+            return false;
+        }
+    } else {
+        if (!updateBalance(oldAccountId, -oldDelta)) {
+            rollback();
+            return false;
+        }
+        if (!updateBalance(tx.accountId, newDelta)) {
+            rollback();
+            return false;
+        }
+    }
+
+    qint64 generation = 0;
+    if (!applySpendRollup(old.categoryId, oldMonth, oldTypeStr, -oldAmount, -1)
+            || !applySpendRollup(tx.categoryId, monthOf(tx.time), tx.type, tx.amount, 1)
+            || !bumpWriteGeneration(generation)) {
+        rollback();
+        return false;
+    }
+
+    if (!db.commit()) {
+        qCritical() << "Failed to commit updateTransaction:" << db.lastError().text();
+        rollback();
+        return false;
+    }
+    if (columns) {
+        columns->upsert(tx, monthOf(tx.time));
+    }
+    if (cube) {
+        cube->add(old.categoryId, oldAccountId, oldTypeStr, oldMonth, -oldAmount, -1);
+        cube->add(tx.categoryId, tx.accountId, tx.type, monthOf(tx.time), tx.amount, 1);
+        cube->followWrite(generation);
+    }
+
+    scheduleIdleCheckpoint();
+    return true;
+}
+
+QList<Transaction> Database::findTransactions(const TransactionQuery &filter)
+{
+    QList<Transaction> transactions;
+    QString sourceKey;
+    const QString source = transactionSource(rangeStartMs(filter), rangeEndMs(filter), &sourceKey);
+    if (source.isEmpty()) {
+        return transactions;
+    }
+    const bool descending = filter.order == TransactionQuery::Order::NewestFirst;
+    const CompiledQuery compiled = compileTransactionSelect(source, sourceKey, filter, descending, nullptr, filter.limit);
+    const QSharedPointer<QSqlQuery> query = execTransactionQuery(compiled.shape, compiled.sql, compiled.binds);
+    if (!query) {
+        return transactions;
+    }
+    while (query->next()) {
+        transactions.append(decodeRow<Transaction>(*query));
+    }
+    query->finish();
+    return transactions;
+}
+
+TransactionPage Database::findTransactionsPage(const TransactionQuery &filter,
+                                               const TransactionCursor &cursor,
+                                               int pageSize,
+                                               PageDirection direction)
+{
+    TransactionPage page;
+    if (pageSize <= 0) {
+        return page;
+    }
+    QString sourceKey;
+    const QString source = transactionSource(rangeStartMs(filter), rangeEndMs(filter), &sourceKey);
+    if (source.isEmpty()) {
+        return page;
+    }
+
+    // A backward page is read in reverse order, starting next to the cursor,
+    // and flipped afterwards. One extra row tells whether more pages follow.
+    const bool newestFirst = filter.order == TransactionQuery::Order::NewestFirst;
+    const bool backward = direction == PageDirection::Backward;
+    const bool descending = newestFirst != backward;
+    const CompiledQuery compiled = compileTransactionSelect(
+        source, sourceKey, filter, descending, cursor.isValid() ? &cursor : nullptr, pageSize + 1);
+    const QSharedPointer<QSqlQuery> query = execTransactionQuery(compiled.shape, compiled.sql, compiled.binds);
+    if (!query) {
+        return page;
+    }
+    while (query->next()) {
+        if (page.rows.size() == pageSize) {
+            page.hasMore = true;
+            break;
+        }
+        page.rows.append(decodeRow<Transaction>(*query));
+    }
+    query->finish();
+
+    if (backward) {
+        std::reverse(page.rows.begin(), page.rows.end());
+    }
+    if (!page.rows.isEmpty()) {
+        page.first = cursorOf(page.rows.first());
+        page.last = cursorOf(page.rows.last());
+    }
+    return page;
+}
+
+bool Database::forEachTransaction(const TransactionQuery &filter,
+                                  const std::function<bool(const Transaction &)> &visitor)
+{
+    // Deliberately not taken from the statement cache: the visitor may call
+    // back into this Database, even with a query of the same shape, while
+    // this statement is still being stepped.
+    QString sourceKey;
+    const QString source = transactionSource(rangeStartMs(filter), rangeEndMs(filter), &sourceKey);
+    if (source.isEmpty()) {
+        return false;
+    }
+    const bool descending = filter.order == TransactionQuery::Order::NewestFirst;
+    const CompiledQuery compiled = compileTransactionSelect(source, sourceKey, filter, descending, nullptr, filter.limit);
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.prepare(compiled.sql)) {
+        qCritical() << "Failed to prepare transaction scan:" << query.lastError().text();
+        return false;
+    }
+    for (int i = 0; i < compiled.binds.size(); ++i) {
+        query.bindValue(i, compiled.binds.at(i));
+    }
+    if (!query.exec()) {
+        qCritical() << "Failed to scan transactions:" << query.lastError().text();
+        return false;
+    }
+
+    Transaction row;
+    while (query.next()) {
+        RowSchema<Transaction>::decode(query, row);
+        if (!visitor(row)) {
+            break;
+        }
+    }
+    return true;
+}
+
+int Database::countTransactions(const TransactionQuery &filter)
+{
+    QString sourceKey;
+    const QString source = transactionSource(rangeStartMs(filter), rangeEndMs(filter), &sourceKey);
+    if (source.isEmpty()) {
+        return 0;
+    }
+    const CompiledQuery compiled = compileTransactionCount(source, sourceKey, filter);
+    const QSharedPointer<QSqlQuery> query = execTransactionQuery(compiled.shape, compiled.sql, compiled.binds);
+    if (!query || !query->next()) {
+        return 0;
+    }
+    const int count = query->value(0).toInt();
+    query->finish();
+    return count;
+}
+
+QSharedPointer<QSqlQuery> Database::execTransactionQuery(const QString &shape, const QString &sql,
+                                                         const QVariantList &binds)
+{
+    const QSharedPointer<QSqlQuery> query = cachedQuery(QStringLiteral("transactions.query:") + shape, sql);
+    if (!query) {
+        return query;
+    }
+    for (int i = 0; i < binds.size(); ++i) {
+        query->bindValue(i, binds.at(i));
+    }
+    if (!query->exec()) {
+        qCritical() << "Failed to query transactions:" << query->lastError().text();
+        return QSharedPointer<QSqlQuery>();
+    }
+    return query;
+}
+
+QList<Transaction> Database::findTransactions(const QString &filter)
+{
+    // The filter is free-form SQL, so this statement cannot be cached.
+    QList<Transaction> transactions;
+    QSqlQuery query(db);
+    QString queryString = selectFrom<Transaction>("transactions");
+    if (!filter.isEmpty()) {
+        queryString += " WHERE " + filter;
+    }
+    queryString += " ORDER BY time DESC";
+
+    if(query.exec(queryString)) {
+        while (query.next()) {
+            transactions.append(decodeRow<Transaction>(query));
+        }
+    } else {
+        qCritical() << "Failed to find transactions:" << query.lastError().text();
+    }
+    return transactions;
+}
+
+Money Database::calculateSpent(int categoryId, int month)
+{
+    const QSharedPointer<QSqlQuery> query = cachedQuery(
+        QStringLiteral("spendRollup.selectSpent"),
+        "SELECT total FROM spend_rollup WHERE categoryId = :categoryId AND month = :month "
+        "AND type = 'Expense'");
+    if (!query) {
+        return Money();
+    }
+    query->bindValue(":categoryId", categoryId);
+    query->bindValue(":month", month);
+
+    if (!query->exec()) {
+        qCritical() << "Failed to calculate spent:" << query->lastError().text();
+        return Money();
+    }
+    // No cell means nothing was ever spent there.
+    const Money spent = query->next() ? Money::fromMinor(query->value(0).toLongLong()) : Money();
+    query->finish();
+    return spent;
+}
+
+QList<RollupDrift> Database::verifySpendRollup()
+{
+    // Cells missing on either side compare as zero, so zero-count cells
+    // left behind by deletes are not drift.
+    QList<RollupDrift> drift;
+    const QString source = transactionSource(std::numeric_limits<qint64>::min(),
+                                              std::numeric_limits<qint64>::max());
+    if (source.isEmpty()) {
+        return drift;
+    }
+    QSqlQuery query(db);
+    const QString sql = QStringLiteral(
+        "WITH actual(categoryId, month, type, total, count) AS (%1) "
+        "SELECT categoryId, month, type, SUM(storedTotal), SUM(actualTotal), "
+        "SUM(storedCount), SUM(actualCount) FROM ("
+        "SELECT categoryId, month, type, total AS storedTotal, 0 AS actualTotal, "
+        "count AS storedCount, 0 AS actualCount FROM spend_rollup "
+        "UNION ALL "
+        "SELECT categoryId, month, type, 0, total, 0, count FROM actual) "
+        "GROUP BY categoryId, month, type "
+        "HAVING SUM(storedTotal) != SUM(actualTotal) OR SUM(storedCount) != SUM(actualCount) "
+        "ORDER BY categoryId, month, type").arg(recomputeRollupSql(source));
+    if (!query.exec(sql)) {
+        qCritical() << "Failed to verify spend rollup:" << query.lastError().text();
+        return drift;
+    }
+    while (query.next()) {
+        RollupDrift cell;
+        cell.categoryId = query.value(0).toInt();
+        cell.month = query.value(1).toInt();
+        cell.type = query.value(2).toString();
+        cell.storedTotal = Money::fromMinor(query.value(3).toLongLong());
+        cell.actualTotal = Money::fromMinor(query.value(4).toLongLong());
+        cell.storedCount = query.value(5).toLongLong();
+        cell.actualCount = query.value(6).toLongLong();
+        drift.append(cell);
+    }
+    return drift;
+}
+
+bool Database::rebuildSpendRollup()
+{
+    const QString source = transactionSource(std::numeric_limits<qint64>::min(),
+                                              std::numeric_limits<qint64>::max());
+    if (source.isEmpty()) {
+        return false;
+    }
+    if (!db.transaction()) {
+        qCritical() << "Failed to start DB transaction:" << db.lastError().text();
+        return false;
+    }
+    QSqlQuery query(db);
+    if (!query.exec("DELETE FROM spend_rollup")
+            || !query.exec(QStringLiteral("INSERT INTO spend_rollup (categoryId, month, type, total, count) ")
+                           + recomputeRollupSql(source))) {
+        qCritical() << "Failed to rebuild spend rollup:" << query.lastError().text();
+        rollback();
+        return false;
+    }
+    if (!db.commit()) {
+        qCritical() << "Failed to commit spend rollup rebuild:" << db.lastError().text();
+        rollback();
+        return false;
+    }
+    scheduleIdleCheckpoint();
+    return true;
+}
+
+std::optional<QList<ReportRow>> Database::aggregateTransactions(qint64 fromMs, qint64 toMs, int dimensions)
+{
+    QString sourceKey;
+    const QString source = transactionSource(fromMs, toMs, &sourceKey);
+    if (source.isEmpty()) {
+        return std::nullopt;
+    }
+
+    // Dimensions left out are selected as constants, so every row decodes
+    // the same way.
+    struct Column {
+        int flag;
+        const char *expression;
+        const char *constant;
+    };
+    static const Column columns[] = {
+        {ByCategory, "IFNULL(categoryId, 0)", "0"},
+        {ByAccount, "accountId", "0"},
+        {ByType, "type", "''"},
+        {ByMonth, "month", "0"},
+    };
+    QStringList selected;
+    QStringList grouped;
+    for (const Column &column : columns) {
+        if (dimensions & column.flag) {
+            selected << QString::fromLatin1(column.expression);
+            grouped << QString::number(selected.size());
+        } else {
+            selected << QString::fromLatin1(column.constant);
+        }
+    }
+    QString sql = QStringLiteral("SELECT ") + selected.join(QStringLiteral(", "))
+            + QStringLiteral(", SUM(amount), COUNT(*) FROM ") + source
+            + QStringLiteral(" WHERE time >= :from AND time < :to");
+    if (!grouped.isEmpty()) {
+        const QString keys = grouped.join(QStringLiteral(", "));
+        sql += QStringLiteral(" GROUP BY ") + keys + QStringLiteral(" ORDER BY ") + keys;
+    }
+
+    const QSharedPointer<QSqlQuery> query = cachedQuery(
+        QStringLiteral("report.aggregate%1").arg(dimensions & AllDimensions) + sourceKey, sql);
+    if (!query) {
+        return std::nullopt;
+    }
+    query->bindValue(":from", fromMs);
+    query->bindValue(":to", toMs);
+    if (!query->exec()) {
+        qCritical() << "Failed to aggregate transactions:" << query->lastError().text();
+        return std::nullopt;
+    }
+    QList<ReportRow> rows;
+    while (query->next()) {
+        // With nothing to group by, an empty range still yields one row.
+        const qint64 count = query->value(5).toLongLong();
+        if (count == 0) {
+            continue;
+        }
+        rows.append(ReportRow{query->value(0).toInt(), query->value(1).toInt(), query->value(2).toString(),
+                              query->value(3).toInt(), Money::fromMinor(query->value(4).toLongLong()), count});
+    }
+    query->finish();
+    return rows;
+}
+
+std::optional<QPair<qint64, qint64>> Database::transactionTimeSpan()
+{
+    const QString source = transactionSource(std::numeric_limits<qint64>::min(),
+                                              std::numeric_limits<qint64>::max());
+    if (source.isEmpty()) {
+        return std::nullopt;
+    }
+    QSqlQuery query(db);
+    if (!query.exec(QStringLiteral("SELECT MIN(time), MAX(time) FROM ") + source) || !query.next()) {
+        qCritical() << "Failed to read transaction time span:" << query.lastError().text();
+        return std::nullopt;
+    }
+    if (query.value(0).isNull()) {
+        return qMakePair(qint64(0), qint64(-1));
+    }
+    return qMakePair(query.value(0).toLongLong(), query.value(1).toLongLong());
+}
+
+
+bool Database::addAccount(Account &acc)
+{
+    const QSharedPointer<QSqlQuery> query = cachedQuery(
+        QStringLiteral("accounts.insert"),
+        "INSERT INTO accounts (name, type, balance, openingBalance) "
+        "VALUES (:name, :type, :balance, :openingBalance)");
+    if (!query) {
+        return false;
+    }
+    query->bindValue(":name", acc.name);
+    query->bindValue(":type", acc.type);
+    query->bindValue(":balance", acc.balance.minor());
+    query->bindValue(":openingBalance", acc.balance.minor());
+
+    if (!query->exec()) {
+        qCritical() << "Failed to add account:" << query->lastError().text();
+        return false;
+    }
+    acc.id = query->lastInsertId().toInt();
+    if (accountCacheLoaded) {
+        accountCache.insert(acc.id, acc);
+    }
+    scheduleIdleCheckpoint();
+    return true;
+}
+
+bool Database::updateAccount(const Account &acc)
+{
+    // The opening balance may move, which shifts every checkpoint. Dropped
+    // first: if the update then fails, only derived data is gone.
+    if (!invalidateCheckpoints(acc.id, std::numeric_limits<qint64>::min())) {
+        return false;
+    }
+    const QSharedPointer<QSqlQuery> query = cachedQuery(
+        QStringLiteral("accounts.update"),
+        // A balance set by hand is an adjustment of the opening balance; the
+        // right-hand sides all see the row as it was before the update.
+        "UPDATE accounts SET name = :name, type = :type, "
+        "openingBalance = openingBalance + (:newBalance - balance), balance = :balance WHERE id = :id");
+    if (!query) {
+        return false;
+    }
+    query->bindValue(":name", acc.name);
+    query->bindValue(":type", acc.type);
+    query->bindValue(":newBalance", acc.balance.minor());
+    query->bindValue(":balance", acc.balance.minor());
+    query->bindValue(":id", acc.id);
+
+    if (!query->exec()) {
+        qCritical() << "Failed to update account:" << query->lastError().text();
+        return false;
+    }
+    if (accountCacheLoaded && query->numRowsAffected() == 1) {
+        accountCache.insert(acc.id, acc);
+    }
+    scheduleIdleCheckpoint();
+    return true;
+}
+
+QList<Account> Database::getAllAccounts()
+{
+    QList<Account> accounts;
+    const QSharedPointer<QSqlQuery> query = cachedQuery(
+        QStringLiteral("accounts.selectAll"),
+        selectFrom<Account>("accounts"));
+    if (!query || !query->exec()) {
+        return accounts;
+    }
+    // The full table is in hand, so refresh the cache with it.
+    accountCache.clear();
+    while (query->next()) {
+        const Account acc = decodeRow<Account>(*query);
+        accounts.append(acc);
+        accountCache.insert(acc.id, acc);
+    }
+    query->finish();
+    accountCacheLoaded = true;
+    return accounts;
+}
+
+bool Database::updateBalance(int accountId, Money amount)
+{
+    const QSharedPointer<QSqlQuery> query = cachedQuery(
+        QStringLiteral("accounts.addToBalance"),
+        "UPDATE accounts SET balance = balance + :amount WHERE id = :id");
+    if (!query) {
+        return false;
+    }
+    query->bindValue(":amount", amount.minor());
+    query->bindValue(":id", accountId);
+    if (!query->exec()) {
+        qCritical() << "Failed to update balance:" << query->lastError().text();
+        return false;
+    }
+    if (query->numRowsAffected() != 1) {
+        return false;
+    }
+    if (accountCacheLoaded) {
+        const auto it = accountCache.find(accountId);
+        if (it != accountCache.end()) {
+            it->balance += amount;
+        }
+    }
+    scheduleIdleCheckpoint();
+    return true;
+}
+
+std::optional<QList<BalanceDrift>> Database::verifyBalances(int fromAccountId, int toAccountId)
+{
+    const QSharedPointer<QSqlQuery> query = cachedQuery(
+        QStringLiteral("accounts.verifyBalances"),
+        QStringLiteral("SELECT id, balance, expected FROM (SELECT a.id AS id, a.balance AS balance, ")
+        + expectedBalanceSql(QStringLiteral("a"))
+        + QStringLiteral(" AS expected FROM accounts a WHERE a.id >= :fromId AND a.id < :toId) "
+                         "WHERE balance <> expected ORDER BY id"));
+    if (!query) {
+        return std::nullopt;
+    }
+    query->bindValue(":fromId", fromAccountId);
+    query->bindValue(":toId", toAccountId);
+    if (!query->exec()) {
+        qCritical() << "Failed to verify balances:" << query->lastError().text();
+        return std::nullopt;
+    }
+    QList<BalanceDrift> drift;
+    while (query->next()) {
+        drift.append(BalanceDrift{query->value(0).toInt(),
+                                  Money::fromMinor(query->value(1).toLongLong()),
+                                  Money::fromMinor(query->value(2).toLongLong())});
+    }
+    query->finish();
+    return drift;
+}
+
+bool Database::repairBalances(const QList<int> &accountIds)
+{
+    if (accountIds.isEmpty()) {
+        return true;
+    }
+    if (!db.transaction()) {
+        qCritical() << "Failed to start DB transaction:" << db.lastError().text();
+        return false;
+    }
+    // Recomputed inside the write transaction, so rows committed since the
+    // drift was found are included.
+    const QSharedPointer<QSqlQuery> query = cachedQuery(
+        QStringLiteral("accounts.repairBalance"),
+        QStringLiteral("UPDATE accounts SET balance = ") + expectedBalanceSql(QStringLiteral("accounts"))
+        + QStringLiteral(" WHERE id = :id"));
+    if (!query) {
+        rollback();
+        return false;
+    }
+    for (int id : accountIds) {
+        query->bindValue(":id", id);
+        if (!query->exec()) {
+            qCritical() << "Failed to repair balance:" << query->lastError().text();
+            rollback();
+            return false;
+        }
+    }
+    if (!db.commit()) {
+        qCritical() << "Failed to commit balance repair:" << db.lastError().text();
+        rollback();
+        return false;
+    }
+    accountCache.clear();
+    accountCacheLoaded = false;
+    scheduleIdleCheckpoint();
+    return true;
+}
+
+bool Database::invalidateCheckpoints(int accountId, qint64 timeMs)
+{
+    const QSharedPointer<QSqlQuery> query = cachedQuery(
+        QStringLiteral("checkpoints.invalidate"),
+        "DELETE FROM balance_checkpoints WHERE accountId = :accountId AND startMs > :time");
+    if (!query) {
+        return false;
+    }
+    query->bindValue(":accountId", accountId);
+    query->bindValue(":time", timeMs);
+    if (!query->exec()) {
+        qCritical() << "Failed to invalidate balance checkpoints:" << query->lastError().text();
+        return false;
+    }
+    return true;
+}
+
+std::optional<Money> Database::balanceAsOf(int accountId, const QDateTime &at)
+{
+    const qint64 atMs = at.toMSecsSinceEpoch();
+    QString sourceKey;
+    const QString source = transactionSource(std::numeric_limits<qint64>::min(), atMs, &sourceKey);
+    if (source.isEmpty()) {
+        return std::nullopt;
+    }
+    const QSharedPointer<QSqlQuery> baseQuery = cachedQuery(
+        QStringLiteral("checkpoints.selectBase"),
+        "SELECT a.openingBalance, c.startMs, c.balance FROM accounts a "
+        "LEFT JOIN balance_checkpoints c ON c.accountId = a.id AND c.startMs = "
+        "(SELECT MAX(startMs) FROM balance_checkpoints WHERE accountId = a.id AND startMs <= :at) "
+        "WHERE a.id = :id");
+    if (!baseQuery) {
+        return std::nullopt;
+    }
+    baseQuery->bindValue(":at", atMs);
+    baseQuery->bindValue(":id", accountId);
+    if (!baseQuery->exec()) {
+        qCritical() << "Failed to read balance checkpoint:" << baseQuery->lastError().text();
+        return std::nullopt;
+    }
+    if (!baseQuery->next()) {
+        return std::nullopt;
+    }
+    const bool hasCheckpoint = !baseQuery->value(1).isNull();
+    Money balance = Money::fromMinor(baseQuery->value(hasCheckpoint ? 2 : 0).toLongLong());
+    const qint64 fromMs = hasCheckpoint ? baseQuery->value(1).toLongLong()
+                                        : std::numeric_limits<qint64>::min();
+    baseQuery->finish();
+
+    // A range on the covering (accountId, time, type, amount) index, in
+    // each file the range reaches.
+    const QSharedPointer<QSqlQuery> sumQuery = cachedQuery(
+        QStringLiteral("checkpoints.sumSince") + sourceKey,
+        QStringLiteral("SELECT IFNULL(SUM(") + QString::fromLatin1(kBalanceDeltaSql)
+        + QStringLiteral("), 0) FROM ") + source
+        + QStringLiteral(" WHERE accountId = :id AND time >= :from AND time < :at"));
+    if (!sumQuery) {
+        return std::nullopt;
+    }
+    sumQuery->bindValue(":id", accountId);
+    sumQuery->bindValue(":from", fromMs);
+    sumQuery->bindValue(":at", atMs);
+    if (!sumQuery->exec() || !sumQuery->next()) {
+        qCritical() << "Failed to sum transactions since checkpoint:" << sumQuery->lastError().text();
+        return std::nullopt;
+    }
+    balance += Money::fromMinor(sumQuery->value(0).toLongLong());
+    sumQuery->finish();
+    return balance;
+}
+
+bool Database::refreshBalanceCheckpoints(const QDateTime &upTo)
+{
+    const QDate upToDate = upTo.toUTC().date();
+    const qint64 limitMs = QDateTime(QDate(upToDate.year(), upToDate.month(), 1), QTime(0, 0), Qt::UTC)
+            .toMSecsSinceEpoch();
+    QString sourceKey;
+    const QString source = transactionSource(std::numeric_limits<qint64>::min(), limitMs, &sourceKey);
+    if (source.isEmpty()) {
+        return false;
+    }
+
+    if (!db.transaction()) {
+        qCritical() << "Failed to start DB transaction:" << db.lastError().text();
+        return false;
+    }
+
+    // Where each account continues from: its latest checkpoint, or the
+    // opening balance before any row.
+    QList<CheckpointStart> starts;
+    QSqlQuery startQuery(db);
+    if (!startQuery.exec("SELECT a.id, a.openingBalance, c.startMs, c.balance FROM accounts a "
+                         "LEFT JOIN balance_checkpoints c ON c.accountId = a.id AND c.startMs = "
+                         "(SELECT MAX(startMs) FROM balance_checkpoints WHERE accountId = a.id)")) {
+        qCritical() << "Failed to read balance checkpoints:" << startQuery.lastError().text();
+        rollback();
+        return false;
+    }
+    while (startQuery.next()) {
+        const bool hasCheckpoint = !startQuery.value(2).isNull();
+        starts.append(CheckpointStart{startQuery.value(0).toInt(),
+                            Money::fromMinor(startQuery.value(hasCheckpoint ? 3 : 1).toLongLong()),
+                            hasCheckpoint ? startQuery.value(2).toLongLong()
+                                          : std::numeric_limits<qint64>::min()});
+    }
+    startQuery.finish();
+
+    const QSharedPointer<QSqlQuery> monthQuery = cachedQuery(
+        QStringLiteral("checkpoints.sumByMonth") + sourceKey,
+        QStringLiteral("SELECT CAST(strftime('%s', time / 1000, 'unixepoch', 'start of month') AS INTEGER) * 1000, "
+                       "SUM(") + QString::fromLatin1(kBalanceDeltaSql)
+        + QStringLiteral(") FROM ") + source
+        + QStringLiteral(" WHERE accountId = :id AND time >= :from AND time < :to GROUP BY 1 ORDER BY 1"));
+    const QSharedPointer<QSqlQuery> insertQuery = cachedQuery(
+        QStringLiteral("checkpoints.insert"),
+        "INSERT OR REPLACE INTO balance_checkpoints (accountId, startMs, balance) "
+        "VALUES (:accountId, :startMs, :balance)");
+    if (!monthQuery || !insertQuery) {
+        rollback();
+        return false;
+    }
+
+    for (const CheckpointStart &start : starts) {
+        if (start.fromMs >= limitMs) {
+            continue;
+        }
+        monthQuery->bindValue(":id", start.accountId);
+        monthQuery->bindValue(":from", start.fromMs);
+        monthQuery->bindValue(":to", limitMs);
+        if (!monthQuery->exec()) {
+            qCritical() << "Failed to sum transactions by month:" << monthQuery->lastError().text();
+            rollback();
+            return false;
+        }
+        // A checkpoint after every month that has rows; quiet months are
+        // covered by the one before them.
+        QList<BalanceCheckpoint> checkpoints;
+        Money running = start.balance;
+        while (monthQuery->next()) {
+            running += Money::fromMinor(monthQuery->value(1).toLongLong());
+            const qint64 nextMonthMs = QDateTime::fromMSecsSinceEpoch(monthQuery->value(0).toLongLong(), Qt::UTC)
+                    .addMonths(1).toMSecsSinceEpoch();
+            checkpoints.append(BalanceCheckpoint{nextMonthMs, running});
+        }
+        monthQuery->finish();
+
+        for (const BalanceCheckpoint &checkpoint : checkpoints) {
+            insertQuery->bindValue(":accountId", start.accountId);
+            insertQuery->bindValue(":startMs", checkpoint.startMs);
+            insertQuery->bindValue(":balance", checkpoint.balance.minor());
+            if (!insertQuery->exec()) {
+                qCritical() << "Failed to write balance checkpoint:" << insertQuery->lastError().text();
+                rollback();
+                return false;
+            }
+        }
+    }
+
+    if (!db.commit()) {
+        qCritical() << "Failed to commit balance checkpoints:" << db.lastError().text();
+        rollback();
+        return false;
+    }
+    scheduleIdleCheckpoint();
+    return true;
+}
+
+bool Database::archiveYear(int year)
+{
+    if (options.readOnly) {
+        qCritical() << "Cannot archive through a read-only connection";
+        return false;
+    }
+    if (year >= QDateTime::currentDateTimeUtc().date().year()) {
+        qCritical() << "Only closed years can be archived, not" << year;
+        return false;
+    }
+
+    ArchivePartition partition;
+    partition.year = year;
+    partition.fileName = QStringLiteral("%1-%2.db").arg(QFileInfo(db.databaseName()).completeBaseName()).arg(year);
+    partition.fromMs = QDateTime(QDate(year, 1, 1), QTime(0, 0), Qt::UTC).toMSecsSinceEpoch();
+    partition.toMs = QDateTime(QDate(year + 1, 1, 1), QTime(0, 0), Qt::UTC).toMSecsSinceEpoch();
+    partition.rowCount = 0;
+    QString schema = partitionSchema(year);
+    for (const ArchivePartition &existing : partitions) {
+        if (existing.year == year) {
+            partition.fileName = existing.fileName;
+        }
+    }
+    for (const ArchiveFile &file : archiveFiles(partitions)) {
+        if (file.fileName == partition.fileName) {
+            schema = file.schema;
+        }
+    }
+    if (!attachArchive(schema, partition.fileName, QStringList{schema})) {
+        return false;
+    }
+
+    // A commit spanning a WAL main file and an attached file is atomic for
+    // neither, so rows are copied in one transaction and deleted in a
+    // second. A crash in between leaves them in both files, where queries
+    // would count them twice until archiveYear() runs again; the copy
+    // skips the ids the archive already holds.
+    if (!db.transaction()) {
+        qCritical() << "Failed to start DB transaction:" << db.lastError().text();
+        return false;
+    }
+    QSqlQuery query(db);
+    const QStringList archiveSchema = {
+        QStringLiteral("CREATE TABLE IF NOT EXISTS %1.transactions ("
+                       "id INTEGER PRIMARY KEY, "
+                       "amount INTEGER NOT NULL, "
+                       "type TEXT NOT NULL, "
+                       "categoryId INTEGER, "
+                       "accountId INTEGER NOT NULL, "
+                       "time INTEGER NOT NULL, "
+                       "month INTEGER NOT NULL, "
+                       "note TEXT)").arg(schema),
+        QStringLiteral("CREATE INDEX IF NOT EXISTS %1.idx_transactions_time ON transactions(time)").arg(schema),
+        QStringLiteral("CREATE INDEX IF NOT EXISTS %1.idx_transactions_account_time "
+                       "ON transactions(accountId, time, type, amount)").arg(schema),
+    };
+    for (const QString &statement : archiveSchema) {
+        if (!query.exec(statement)) {
+            qCritical() << "Failed to create archive table:" << query.lastError().text();
+            rollback();
+            return false;
+        }
+    }
+    query.prepare(QStringLiteral("INSERT OR IGNORE INTO %1.transactions (%2) "
+                                 "SELECT %2 FROM main.transactions WHERE time >= :from AND time < :to")
+                  .arg(schema, QString::fromLatin1(kTransactionColumns)));
+    query.bindValue(":from", partition.fromMs);
+    query.bindValue(":to", partition.toMs);
+    if (!query.exec()) {
+        qCritical() << "Failed to copy rows to archive:" << query.lastError().text();
+        rollback();
+        return false;
+    }
+    if (!db.commit()) {
+        qCritical() << "Failed to commit archive copy:" << db.lastError().text();
+        rollback();
+        return false;
+    }
+
+    if (!db.transaction()) {
+        qCritical() << "Failed to start DB transaction:" << db.lastError().text();
+        return false;
+    }
+    // The moved rows keep counting towards their accounts' expected
+    // balance, and towards the spend rollup, which is left as it is.
+    query.prepare(QStringLiteral("INSERT INTO archived_balances (accountId, delta, count) "
+                                 "SELECT accountId, SUM(%1), COUNT(*) FROM main.transactions "
+                                 "WHERE time >= :from AND time < :to GROUP BY accountId "
+                                 "ON CONFLICT (accountId) DO UPDATE SET "
+                                 "delta = delta + excluded.delta, count = count + excluded.count")
+                  .arg(QString::fromLatin1(kBalanceDeltaSql)));
+    query.bindValue(":from", partition.fromMs);
+    query.bindValue(":to", partition.toMs);
+    if (!query.exec()) {
+        qCritical() << "Failed to record archived balances:" << query.lastError().text();
+        rollback();
+        return false;
+    }
+    query.prepare("DELETE FROM main.transactions WHERE time >= :from AND time < :to");
+    query.bindValue(":from", partition.fromMs);
+    query.bindValue(":to", partition.toMs);
+    if (!query.exec()) {
+        qCritical() << "Failed to remove archived rows:" << query.lastError().text();
+        rollback();
+        return false;
+    }
+    const qint64 moved = query.numRowsAffected();
+    query.prepare("INSERT INTO partitions (year, fileName, fromMs, toMs, rowCount) "
+                  "VALUES (:year, :fileName, :fromMs, :toMs, :rowCount) "
+                  "ON CONFLICT (year) DO UPDATE SET rowCount = rowCount + excluded.rowCount");
+    query.bindValue(":year", year);
+    query.bindValue(":fileName", partition.fileName);
+    query.bindValue(":fromMs", partition.fromMs);
+    query.bindValue(":toMs", partition.toMs);
+    query.bindValue(":rowCount", moved);
+    if (!query.exec()) {
+        qCritical() << "Failed to register archive:" << query.lastError().text();
+        rollback();
+        return false;
+    }
+    if (!db.commit()) {
+        qCritical() << "Failed to commit archive:" << db.lastError().text();
+        rollback();
+        return false;
+    }
+    scheduleIdleCheckpoint();
+    return loadPartitions() && consolidateArchives();
+}
+
+bool Database::consolidateArchives()
+{
+    QList<ArchiveFile> files = archiveFiles(partitions);
+    while (files.size() > kMaxAttachedPartitions) {
+        const ArchiveFile into = files.at(0);
+        const ArchiveFile from = files.at(1);
+        const QStringList both = {into.schema, from.schema};
+        if (!attachArchive(into.schema, into.fileName, both) || !attachArchive(from.schema, from.fileName, both)) {
+            return false;
+        }
+
+        // Copied and re-registered in two transactions, as in archiveYear().
+        // Reads clip every archive to the span of its registered years, and
+        // from's years all come after into's, so copies not yet registered
+        // are never read twice; a rerun skips the ids already copied.
+        if (!db.transaction()) {
+            qCritical() << "Failed to start DB transaction:" << db.lastError().text();
+            return false;
+        }
+        QSqlQuery query(db);
+        if (!query.exec(QStringLiteral("INSERT OR IGNORE INTO %1.transactions (%3) SELECT %3 FROM %2.transactions")
+                        .arg(into.schema, from.schema, QString::fromLatin1(kTransactionColumns)))) {
+            qCritical() << "Failed to fold archive" << from.fileName << ":" << query.lastError().text();
+            rollback();
+            return false;
+        }
+        if (!db.commit()) {
+            qCritical() << "Failed to commit archive fold:" << db.lastError().text();
+            rollback();
+            return false;
+        }
+        if (!db.transaction()) {
+            qCritical() << "Failed to start DB transaction:" << db.lastError().text();
+            return false;
+        }
+        query.prepare("UPDATE partitions SET fileName = :into WHERE fileName = :from");
+        query.bindValue(":into", into.fileName);
+        query.bindValue(":from", from.fileName);
+        if (!query.exec()) {
+            qCritical() << "Failed to register folded archive:" << query.lastError().text();
+            rollback();
+            return false;
+        }
+        if (!db.commit()) {
+            qCritical() << "Failed to commit archive fold:" << db.lastError().text();
+            rollback();
+            return false;
+        }
+        if (!loadPartitions() || !detachArchive(from.schema)) {
+            return false;
+        }
+        // Left behind if a reader still has it open (on Windows); nothing
+        // refers to it any more.
+        const QString path = QFileInfo(db.databaseName()).dir().filePath(from.fileName);
+        if (!QFile::remove(path)) {
+            qWarning() << "Failed to remove folded archive" << path;
+        }
+        files = archiveFiles(partitions);
+    }
+    return true;
+}
+
+QList<ArchivePartition> Database::archivePartitions() const
+{
+    return partitions;
+}
+
+bool Database::loadColumnStore()
+{
+    const QString source = transactionSource(std::numeric_limits<qint64>::min(),
+                                              std::numeric_limits<qint64>::max());
+    if (source.isEmpty()) {
+        return false;
+    }
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.exec(QStringLiteral("SELECT COUNT(*) FROM ") + source) || !query.next()) {
+        qCritical() << "Failed to size column store:" << query.lastError().text();
+        return false;
+    }
+    const int rows = query.value(0).toInt();
+    query.finish();
+
+    QScopedPointer<ColumnStore> loaded(new ColumnStore);
+    loaded->reserve(rows);
+    // In id order, so every later insert is an append.
+    if (!query.exec(QStringLiteral("SELECT ") + selectList<Transaction>()
+                    + QStringLiteral(", month FROM ") + source + QStringLiteral(" ORDER BY id"))) {
+        qCritical() << "Failed to load column store:" << query.lastError().text();
+        return false;
+    }
+    while (query.next()) {
+        loaded->upsert(decodeRow<Transaction>(query), query.value(RowSchema<Transaction>::ColumnCount).toInt());
+    }
+    query.finish();
+    columns.reset(loaded.take());
+    return true;
+}
+
+const ColumnStore *Database::columnStore() const
 {
-    const QString path = QDir::currentPath() + "/ledger.db";
-    return init(path);
+    return columns.data();
 }
 
-bool Database::init(const QString &dbFilePath)
+bool Database::loadSpendCube(const QString &cachePath)
 {
-    // Use a unique connection name per Database instance.
-    // If we used the default connection, multiple Database objects in a single
-    // process (like unit tests) would overwrite each other.
-    if (connectionName.isEmpty()) {
-        connectionName = QStringLiteral("ledger_%1").arg(QUuid::createUuid().toString(QUuid::WithoutBraces));
+    // Read before the cells, so a write landing in between leaves the cube
+    // stamped older than it is, which only costs a rebuild.
+    const std::optional<qint64> generation = writeGeneration();
+    if (!generation) {
+        return false;
+    }
+    QScopedPointer<SpendCube> loaded(new SpendCube);
+    if (!cachePath.isEmpty() && QFile::exists(cachePath)) {
+        if (loaded->load(cachePath) && loaded->generation() == *generation && spendCubeMatchesTables(*loaded)) {
+            cube.reset(loaded.take());
+            return true;
+        }
+        qWarning() << "Spend cube" << cachePath << "is out of date, rebuilding it";
+        loaded->clear();
     }
 
-    db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
-
-    qDebug() << "Database path:" << dbFilePath;
-    db.setDatabaseName(dbFilePath);
+    const QString source = transactionSource(std::numeric_limits<qint64>::min(),
+                                              std::numeric_limits<qint64>::max());
+    if (source.isEmpty()) {
+        return false;
+    }
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.exec(QStringLiteral("SELECT IFNULL(categoryId, 0), accountId, type, month, SUM(amount), COUNT(*) "
+                                   "FROM %1 GROUP BY 1, 2, 3, 4").arg(source))) {
+        qCritical() << "Failed to load spend cube:" << query.lastError().text();
+        return false;
+    }
+    while (query.next()) {
+        loaded->add(query.value(0).toInt(), query.value(1).toInt(), query.value(2).toString(),
+                    query.value(3).toInt(), Money::fromMinor(query.value(4).toLongLong()),
+                    query.value(5).toLongLong());
+    }
+    query.finish();
+    loaded->setGeneration(*generation);
+    cube.reset(loaded.take());
+    // A cache that cannot be written only costs the next startup a rebuild.
+    if (!cachePath.isEmpty()) {
+        saveSpendCube(cachePath);
+    }
+    return true;
+}
 
-    if (!db.open()) {
-        qCritical() << "Database connection failed:" << db.lastError().text();
+bool Database::saveSpendCube(const QString &path) const
+{
+    if (!cube) {
+        qCritical() << "Cannot save spend cube: not loaded";
         return false;
     }
+    return cube->save(path);
+}
 
-    createTables();
-    return true;
+const SpendCube *Database::spendCube() const
+{
+    return cube.data();
 }
 
-void Database::createTables()
+bool Database::spendCubeMatchesTables(const SpendCube &saved)
 {
+    // The write generation already matched; this catches a cube file saved
+    // from another ledger, or tables changed by hand.
     QSqlQuery query(db);
-    QStringList tables = db.tables();
-
-    if (!tables.contains("transactions")) {
-        if(!query.exec("CREATE TABLE transactions ("
-                      "id INTEGER PRIMARY KEY AUTOINCREMENT, "
-                      "amount REAL NOT NULL, "
-                      "type TEXT NOT NULL, "
-                      "categoryId INTEGER, "
-                      "accountId INTEGER NOT NULL, "
-                      "time TEXT NOT NULL, "
-                      "note TEXT)")) {
-            qCritical() << "Failed to create table transactions:" << query.lastError().text();
-        }
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT categoryId, type, month, total, count FROM spend_rollup "
+                    "WHERE count != 0 ORDER BY categoryId, type, month")) {
+        qCritical() << "Failed to check spend cube:" << query.lastError().text();
+        return false;
     }
-
-    if (!tables.contains("accounts")) {
-        if(!query.exec("CREATE TABLE accounts ("
-                      "id INTEGER PRIMARY KEY AUTOINCREMENT, "
-                      "name TEXT NOT NULL UNIQUE, "
-                      "type TEXT NOT NULL, "
-                      "balance REAL NOT NULL DEFAULT 0)")) {
-            qCritical() << "Failed to create table accounts:" << query.lastError().text();
+    const QList<ReportRow> cells = saved.rollUp(ByCategory | ByType | ByMonth);
+    int matched = 0;
+    while (query.next()) {
+        if (matched == cells.size()) {
+            return false;
         }
-    }
-
-    if (!tables.contains("categories")) {
-        if(!query.exec("CREATE TABLE categories ("
-                      "id INTEGER PRIMARY KEY AUTOINCREMENT, "
-                      "name TEXT NOT NULL UNIQUE, "
-                      "type TEXT NOT NULL)")) {
-            qCritical() << "Failed to create table categories:" << query.lastError().text();
+        const ReportRow &cell = cells.at(matched++);
+        if (cell.categoryId != query.value(0).toInt() || cell.type != query.value(1).toString()
+                || cell.month != query.value(2).toInt()
+                || cell.total != Money::fromMinor(query.value(3).toLongLong())
+                || cell.count != query.value(4).toLongLong()) {
+            return false;
         }
     }
+    query.finish();
+    if (matched != cells.size()) {
+        return false;
+    }
 
-    if (!tables.contains("budgets")) {
-        if(!query.exec("CREATE TABLE budgets ("
-                      "id INTEGER PRIMARY KEY AUTOINCREMENT, "
-                      "categoryId INTEGER NOT NULL, "
-                      "month INTEGER NOT NULL, "
-                      "limit_amount REAL NOT NULL, "
-                      "UNIQUE(categoryId, month))")) {
-            qCritical() << "Failed to create table budgets:" << query.lastError().text();
+    QHash<int, Money> deltas;
+    for (const ReportRow &row : saved.rollUp(ByAccount | ByType)) {
+        deltas[row.accountId] += balanceDeltaFor(parseTxType(row.type), row.total);
+    }
+    if (!query.exec("SELECT id, openingBalance, balance FROM accounts")) {
+        qCritical() << "Failed to check spend cube:" << query.lastError().text();
+        return false;
+    }
+    while (query.next()) {
+        const Money expected = Money::fromMinor(query.value(1).toLongLong()) + deltas.value(query.value(0).toInt());
+        if (expected != Money::fromMinor(query.value(2).toLongLong())) {
+            return false;
         }
     }
+    return true;
 }
 
-bool Database::addTransaction(Transaction &tx)
+bool Database::backupTo(const QString &path, const std::function<void(const BackupProgress &)> &progress)
 {
-    const TxType txType = parseTxType(tx.type);
-    if (txType == TxType::Unknown) {
-        qCritical() << "Unsupported transaction type:" << tx.type;
+    if (options.readOnly && !loadPartitions()) {
         return false;
     }
+    const QString databasePath = db.databaseName();
+    const QDir sourceDir = QFileInfo(databasePath).dir();
+    const QDir targetDir = QFileInfo(path).dir();
 
-    if (!db.transaction()) {
-        qCritical() << "Failed to start DB transaction:" << db.lastError().text();
-        return false;
+    QList<BackupFile> files;
+    files.append(BackupFile{QStringLiteral("main"), QString(), path});
+    for (const ArchiveFile &archive : archiveFiles(partitions)) {
+        files.append(BackupFile{archive.schema, sourceDir.filePath(archive.fileName),
+                                targetDir.filePath(archive.fileName)});
+    }
+    // The WAL holds pages not yet checkpointed into the file, so the source
+    // size is a rough guess at how much will be written.
+    QStringList sources = {databasePath, databasePath + QStringLiteral("-wal")};
+    QStringList targets;
+    for (const BackupFile &file : files) {
+        if (QFileInfo::exists(file.targetPath)) {
+            qCritical() << "Backup target already exists:" << file.targetPath;
+            return false;
+        }
+        if (!file.sourcePath.isEmpty()) {
+            sources.append(file.sourcePath);
+        }
+        targets.append(file.targetPath);
     }
 
-    QSqlQuery query(db);
-    query.prepare("INSERT INTO transactions (amount, type, categoryId, accountId, time, note) "
-                  "VALUES (:amount, :type, :categoryId, :accountId, :time, :note)");
-    query.bindValue(":amount", tx.amount);
-    query.bindValue(":type", tx.type);
-    query.bindValue(":categoryId", tx.categoryId);
-    query.bindValue(":accountId", tx.accountId);
-    query.bindValue(":time", tx.time.toString(Qt::ISODate));
-    query.bindValue(":note", tx.note);
+    BackupProgress report;
+    report.totalBytes = totalFileSize(sources);
+    QElapsedTimer timer;
+    timer.start();
 
-    if (!query.exec()) {
-        qCritical() << "Failed to add transaction:" << query.lastError().text();
-        db.rollback();
-        return false;
+    bool ok = false;
+    QThread *worker = QThread::create([&ok, databasePath, files]() { ok = vacuumInto(databasePath, files); });
+    worker->setObjectName(QStringLiteral("LedgerBackup"));
+    worker->start();
+    while (!worker->wait(kBackupPollMs)) {
+        if (progress) {
+            report.bytesCopied = qMin(totalFileSize(targets), report.totalBytes);
+            report.elapsedMs = timer.elapsed();
+            progress(report);
+        }
     }
-    tx.id = query.lastInsertId().toInt();
+    delete worker;
 
-    const double delta = balanceDeltaFor(txType, tx.amount);
-    if (!updateBalance(tx.accountId, delta)) {
-        db.rollback();
+    if (!ok) {
+        for (const QString &target : targets) {
+            QFile::remove(target);
+        }
         return false;
     }
-
-    if (!db.commit()) {
-        qCritical() << "Failed to commit addTransaction:" << db.lastError().text();
-        db.rollback();
-        return false;
+    if (progress) {
+        report.bytesCopied = totalFileSize(targets);
+        report.totalBytes = report.bytesCopied;
+        report.elapsedMs = timer.elapsed();
+        progress(report);
     }
     return true;
 }
 
-bool Database::deleteTransaction(int id)
+bool Database::loadPartitions()
 {
-    if (!db.transaction()) {
-        qCritical() << "Failed to start DB transaction:" << db.lastError().text();
+    const QSharedPointer<QSqlQuery> query = cachedQuery(
+        QStringLiteral("partitions.select"),
+        "SELECT year, fileName, fromMs, toMs, rowCount FROM partitions ORDER BY year");
+    if (!query) {
         return false;
     }
-    QSqlQuery selectQuery(db);
-    selectQuery.prepare("SELECT amount, type, accountId FROM transactions WHERE id = :id");
-    selectQuery.bindValue(":id", id);
-    if (!selectQuery.exec() || !selectQuery.next()) {
-        qCritical() << "Failed to retrieve transaction for deletion:" << selectQuery.lastError().text();
-        db.rollback();
+    if (!query->exec()) {
+        qCritical() << "Failed to read archive partitions:" << query->lastError().text();
         return false;
     }
-
-    double amount = selectQuery.value("amount").toDouble();
-    QString type = selectQuery.value("type").toString();
-    int accountId = selectQuery.value("accountId").toInt();
-
-    const TxType txType = parseTxType(type);
-    if (txType == TxType::Unknown) {
-        qCritical() << "Unsupported transaction type:" << type;
-        db.rollback();
-        return false;
+    QList<ArchivePartition> loaded;
+    while (query->next()) {
+        ArchivePartition partition;
+        partition.year = query->value(0).toInt();
+        partition.fileName = query->value(1).toString();
+        partition.fromMs = query->value(2).toLongLong();
+        partition.toMs = query->value(3).toLongLong();
+        partition.rowCount = query->value(4).toLongLong();
+        loaded.append(partition);
     }
+    query->finish();
+    partitions = loaded;
+    return true;
+}
 
-    QSqlQuery deleteQuery(db);
-    deleteQuery.prepare("DELETE FROM transactions WHERE id = :id");
-    deleteQuery.bindValue(":id", id);
-
-    if (deleteQuery.exec() && deleteQuery.numRowsAffected() == 1) {
-        const double deltaApplied = balanceDeltaFor(txType, amount);
-        if(updateBalance(accountId, -deltaApplied)) {
-            db.commit();
-            return true;
+QString Database::transactionSource(qint64 fromMs, qint64 toMs, QString *key)
+{
+    // A reader does not see the writer archive; the registry is small
+    // enough to simply re-read.
+    if (options.readOnly && !loadPartitions()) {
+        return QString();
+    }
+    QList<ArchiveFile> overlapping;
+    QStringList schemas;
+    for (const ArchiveFile &file : archiveFiles(partitions)) {
+        if (file.fromMs < toMs && file.toMs > fromMs) {
+            overlapping.append(file);
+            schemas.append(file.schema);
         }
     }
-    
-    qCritical() << "Failed to delete transaction:" << deleteQuery.lastError().text();
-    db.rollback();
-    return false;
+    if (key) {
+        key->clear();
+    }
+    if (overlapping.isEmpty()) {
+        return QStringLiteral("transactions");
+    }
+    // consolidateArchives() keeps the files under the limit; this only
+    // trips if it has failed.
+    if (overlapping.size() > kMaxAttachedPartitions) {
+        qCritical() << "Range spans" << overlapping.size() << "archive files, more than"
+                    << kMaxAttachedPartitions << "can be read at once";
+        return QString();
+    }
+    for (const ArchiveFile &file : overlapping) {
+        if (!attachArchive(file.schema, file.fileName, schemas)) {
+            return QString();
+        }
+    }
+
+    // The outer WHERE is pushed down into each arm, so every file still
+    // answers from its own indexes. Each archive is clipped to the span of
+    // its registered years (see consolidateArchives()).
+    const QString columns = QString::fromLatin1(kTransactionColumns);
+    QString source = QStringLiteral("(SELECT %1 FROM main.transactions").arg(columns);
+    QStringList years;
+    for (const ArchiveFile &file : overlapping) {
+        source += QStringLiteral(" UNION ALL SELECT %1 FROM %2.transactions WHERE time >= %3 AND time < %4")
+                .arg(columns, file.schema).arg(file.fromMs).arg(file.toMs);
+        years.append(QStringLiteral("%1-%2").arg(file.firstYear).arg(file.lastYear));
+    }
+    if (key) {
+        // The years of each file fix its schema and clip, so they name the
+        // whole source far more briefly than its text.
+        *key = QStringLiteral("@") + years.join(QChar(','));
+    }
+    return source + QStringLiteral(") AS transactions");
 }
 
-bool Database::updateTransaction(const Transaction &tx)
+bool Database::attachArchive(const QString &schema, const QString &fileName, const QStringList &keep)
 {
-    if (!db.transaction()) {
-        qCritical() << "Failed to start DB transaction:" << db.lastError().text();
-        return false;
+    const int index = attachedPartitions.indexOf(schema);
+    if (index >= 0) {
+        attachedPartitions.move(index, attachedPartitions.size() - 1);
+        return true;
     }
 
-    QSqlQuery oldQuery(db);
-    oldQuery.prepare("SELECT amount, type, accountId FROM transactions WHERE id = :id");
-    oldQuery.bindValue(":id", tx.id);
-    if (!oldQuery.exec() || !oldQuery.next()) {
-        qCritical() << "Failed to retrieve old transaction:" << oldQuery.lastError().text();
-        db.rollback();
-        return false;
+    if (attachedPartitions.size() >= kMaxAttachedPartitions) {
+        const auto victim = std::find_if(attachedPartitions.constBegin(), attachedPartitions.constEnd(),
+                                         [&keep](const QString &attached) { return !keep.contains(attached); });
+        if (victim != attachedPartitions.constEnd() && !detachArchive(QString(*victim))) {
+            return false;
+        }
     }
 
-    const double oldAmount = oldQuery.value("amount").toDouble();
-    const QString oldTypeStr = oldQuery.value("type").toString();
-    const int oldAccountId = oldQuery.value("accountId").toInt();
-
-    const TxType oldType = parseTxType(oldTypeStr);
-    const TxType newType = parseTxType(tx.type);
-    if (oldType == TxType::Unknown || newType == TxType::Unknown) {
-        qCritical() << "Unsupported transaction type:" << oldTypeStr << tx.type;
-        db.rollback();
+    QSqlQuery query(db);
+    const QString path = QFileInfo(db.databaseName()).dir().filePath(fileName);
+    query.prepare(QStringLiteral("ATTACH DATABASE :path AS %1").arg(schema));
+    query.bindValue(":path", path);
+    if (!query.exec()) {
+        qCritical() << "Failed to attach archive" << path << ":" << query.lastError().text();
         return false;
     }
+    attachedPartitions.append(schema);
+    return true;
+}
 
-    const double oldDelta = balanceDeltaFor(oldType, oldAmount);
-    const double newDelta = balanceDeltaFor(newType, tx.amount);
-
+bool Database::detachArchive(const QString &schema)
+{
+    // Statements prepared against the archive hold it open; the rest stay
+    // cached.
+    dropCachedStatements(schema);
     QSqlQuery query(db);
-    query.prepare("UPDATE transactions SET amount = :amount, type = :type, categoryId = :categoryId, "
-                  "accountId = :accountId, time = :time, note = :note WHERE id = :id");
-    query.bindValue(":amount", tx.amount);
-    query.bindValue(":type", tx.type);
-    query.bindValue(":categoryId", tx.categoryId);
-    query.bindValue(":accountId", tx.accountId);
-    query.bindValue(":time", tx.time.toString(Qt::ISODate));
-    query.bindValue(":note", tx.note);
-    query.bindValue(":id", tx.id);
-
-    if (!query.exec() || query.numRowsAffected() != 1) {
-        qCritical() << "Failed to update transaction:" << query.lastError().text();
-        db.rollback();
+    if (!query.exec(QStringLiteral("DETACH DATABASE %1").arg(schema))) {
+        qCritical() << "Failed to detach archive:" << query.lastError().text();
         return false;
     }
+    attachedPartitions.removeAll(schema);
+    return true;
+}
 
-    if (tx.accountId == oldAccountId) {
-        if (!updateBalance(oldAccountId, newDelta - oldDelta)) {
-            db.rollback();
-            return false;
-        }
-    } else {
-        if (!updateBalance(oldAccountId, -oldDelta)) {
-            db.rollback();
-            return false;
-        }
-        if (!updateBalance(tx.accountId, newDelta)) {
-            db.rollback();
-            return false;
-        }
+bool Database::addCategory(Category &cat)
+{
+    const QSharedPointer<QSqlQuery> query = cachedQuery(
+        QStringLiteral("categories.insert"),
+        "INSERT INTO categories (name, type) VALUES (:name, :type)");
+    if (!query) {
+        return false;
     }
-
-    if (!db.commit()) {
-        qCritical() << "Failed to commit updateTransaction:" << db.lastError().text();
-        db.rollback();
+    query->bindValue(":name", cat.name);
+    query->bindValue(":type", cat.type);
+    if (!query->exec()) {
+        qCritical() << "Failed to add category:" << query->lastError().text();
         return false;
     }
-
+    cat.id = query->lastInsertId().toInt();
+    if (categoryCacheLoaded) {
+        categoryCache.insert(cat.id, cat);
+    }
+    scheduleIdleCheckpoint();
     return true;
 }
 
-QList<Transaction> Database::findTransactions(const QString &filter)
+QList<Category> Database::getAllCategories(const QString &type)
 {
-    QList<Transaction> transactions;
-    QSqlQuery query(db);
-    QString queryString = "SELECT id, amount, type, categoryId, accountId, time, note FROM transactions";
-    if (!filter.isEmpty()) {
-        queryString += " WHERE " + filter;
+    QList<Category> categories;
+    QSharedPointer<QSqlQuery> query;
+    if (type.isEmpty()) {
+        query = cachedQuery(QStringLiteral("categories.selectAll"),
+                            selectFrom<Category>("categories"));
+    } else {
+        query = cachedQuery(QStringLiteral("categories.selectByType"),
+                            selectFrom<Category>("categories") + " WHERE type = :type");
+        if (query) {
+            query->bindValue(":type", type);
+        }
+    }
+    if (!query) {
+        return categories;
     }
-    queryString += " ORDER BY time DESC";
 
-    if(query.exec(queryString)) {
-        while (query.next()) {
-            Transaction tx;
-            tx.id = query.value("id").toInt();
-            tx.amount = query.value("amount").toDouble();
-            tx.type = query.value("type").toString();
-            tx.categoryId = query.value("categoryId").toInt();
-            tx.accountId = query.value("accountId").toInt();
-            tx.time = QDateTime::fromString(query.value("time").toString(), Qt::ISODate);
-            tx.note = query.value("note").toString();
-            transactions.append(tx);
+    if(query->exec()) {
+        while (query->next()) {
+            categories.append(decodeRow<Category>(*query));
         }
+        query->finish();
     } else {
-        qCritical() << "Failed to find transactions:" << query.lastError().text();
+        qCritical() << "Failed to get categories:" << query->lastError().text();
+        return categories;
     }
-    return transactions;
+
+    // An unfiltered read is the whole table, so refresh the cache with it.
+    if (type.isEmpty()) {
+        categoryCache.clear();
+        for (const Category &cat : categories) {
+            categoryCache.insert(cat.id, cat);
+        }
+        categoryCacheLoaded = true;
+    }
+    return categories;
 }
 
-double Database::calculateSpent(int categoryId, int month)
+std::optional<Account> Database::account(int id)
 {
-    QSqlQuery query(db);
-    QDate date = QDate::fromString(QString::number(month) + "01", "yyyyMMdd");
-    QString startDate = date.toString("yyyy-MM-01T00:00:00");
-    QString endDate = date.addMonths(1).toString("yyyy-MM-01T00:00:00");
-
-    query.prepare("SELECT SUM(amount) FROM transactions WHERE type = 'Expense' AND categoryId = :categoryId "
-                  "AND time >= :startDate AND time < :endDate");
-    query.bindValue(":categoryId", categoryId);
-    query.bindValue(":startDate", startDate);
-    query.bindValue(":endDate", endDate);
+    if (!ensureAccountCache()) {
+        return std::nullopt;
+    }
+    const auto it = accountCache.constFind(id);
+    if (it == accountCache.constEnd()) {
+        return std::nullopt;
+    }
+    return it.value();
+}
 
-    if (query.exec() && query.next()) {
-        return query.value(0).toDouble();
+QString Database::categoryName(int id)
+{
+    if (!ensureCategoryCache()) {
+        return QString();
     }
-    qCritical() << "Failed to calculate spent:" << query.lastError().text();
-    return 0.0;
+    return categoryCache.value(id).name;
 }
 
+bool Database::ensureAccountCache()
+{
+    if (options.readOnly) {
+        dropStaleEntityCaches();
+    }
+    if (!accountCacheLoaded) {
+        getAllAccounts();
+    }
+    return accountCacheLoaded;
+}
 
-bool Database::addAccount(Account &acc)
+bool Database::ensureCategoryCache()
 {
-    QSqlQuery query(db);
-    query.prepare("INSERT INTO accounts (name, type, balance) VALUES (:name, :type, :balance)");
-    query.bindValue(":name", acc.name);
-    query.bindValue(":type", acc.type);
-    query.bindValue(":balance", acc.balance);
+    if (options.readOnly) {
+        dropStaleEntityCaches();
+    }
+    if (!categoryCacheLoaded) {
+        getAllCategories(QString());
+    }
+    return categoryCacheLoaded;
+}
 
-    if (!query.exec()) {
-        qCritical() << "Failed to add account:" << query.lastError().text();
-        return false;
+void Database::dropStaleEntityCaches()
+{
+    // data_version changes whenever another connection commits to the file.
+    auto query = cachedQuery(QStringLiteral("pragma.dataVersion"), QStringLiteral("PRAGMA data_version"));
+    if (!query || !query->exec() || !query->next()) {
+        invalidateEntityCaches();
+        return;
+    }
+    const qint64 version = query->value(0).toLongLong();
+    query->finish();
+    if (version != dataVersion) {
+        invalidateEntityCaches();
+        dataVersion = version;
     }
-    acc.id = query.lastInsertId().toInt();
-    return true;
 }
 
-bool Database::updateAccount(const Account &acc)
+void Database::invalidateEntityCaches()
 {
-    QSqlQuery query(db);
-    query.prepare("UPDATE accounts SET name = :name, type = :type, balance = :balance WHERE id = :id");
-    query.bindValue(":name", acc.name);
-    query.bindValue(":type", acc.type);
-    query.bindValue(":balance", acc.balance);
-    query.bindValue(":id", acc.id);
+    accountCache.clear();
+    categoryCache.clear();
+    accountCacheLoaded = false;
+    categoryCacheLoaded = false;
+}
 
-    if (!query.exec()) {
-        qCritical() << "Failed to update account:" << query.lastError().text();
+bool Database::beginSnapshot()
+{
+    // ATTACH cannot run inside the snapshot, so the archives a full range
+    // would read are attached first.
+    if (transactionSource(std::numeric_limits<qint64>::min(), std::numeric_limits<qint64>::max()).isEmpty()) {
+        return false;
+    }
+    if (!db.transaction()) {
+        qCritical() << "Failed to start read transaction:" << db.lastError().text();
+        return false;
+    }
+    // BEGIN is deferred; the snapshot is taken by the first read.
+    QSqlQuery query(db);
+    if (!query.exec("SELECT 1 FROM sqlite_master LIMIT 1")) {
+        qCritical() << "Failed to open read snapshot:" << query.lastError().text();
+        rollback();
         return false;
     }
     return true;
 }
 
-QList<Account> Database::getAllAccounts()
+void Database::endSnapshot()
 {
-    QList<Account> accounts;
-    QSqlQuery query("SELECT id, name, type, balance FROM accounts", db);
-    while (query.next()) {
-        Account acc;
-        acc.id = query.value("id").toInt();
-        acc.name = query.value("name").toString();
-        acc.type = query.value("type").toString();
-        acc.balance = query.value("balance").toDouble();
-        accounts.append(acc);
+    if (!db.commit()) {
+        qWarning() << "Failed to end read transaction:" << db.lastError().text();
     }
-    return accounts;
 }
 
-bool Database::updateBalance(int accountId, double amount)
+void Database::rollback()
 {
-    QSqlQuery query(db);
-    query.prepare("UPDATE accounts SET balance = balance + :amount WHERE id = :id");
-    query.bindValue(":amount", amount);
-    query.bindValue(":id", accountId);
-    if (!query.exec()) {
-        qCritical() << "Failed to update balance:" << query.lastError().text();
-        return false;
-    }
-    return query.numRowsAffected() == 1;
+    db.rollback();
+    invalidateEntityCaches();
 }
 
-bool Database::addCategory(Category &cat)
+bool Database::setBudget(const Budget &budget)
 {
-    QSqlQuery query(db);
-    query.prepare("INSERT INTO categories (name, type) VALUES (:name, :type)");
-    query.bindValue(":name", cat.name);
-    query.bindValue(":type", cat.type);
-    if (!query.exec()) {
-        qCritical() << "Failed to add category:" << query.lastError().text();
+    // Use INSERT OR REPLACE to handle both new and existing budgets
+    const QSharedPointer<QSqlQuery> query = cachedQuery(
+        QStringLiteral("budgets.upsert"),
+        "INSERT OR REPLACE INTO budgets (categoryId, month, limit_amount) "
+        "VALUES (:categoryId, :month, :limit_amount)");
+    if (!query) {
+        return false;
+    }
+    query->bindValue(":categoryId", budget.categoryId);
+    query->bindValue(":month", budget.month);
+    query->bindValue(":limit_amount", budget.limit.minor());
+
+    if (!query->exec()) {
+        qCritical() << "Failed to set budget:" << query->lastError().text();
         return false;
     }
-    cat.id = query.lastInsertId().toInt();
+    scheduleIdleCheckpoint();
     return true;
 }
 
-QList<Category> Database::getAllCategories(const QString &type)
+Budget Database::getBudget(int categoryId, int month)
 {
-    QList<Category> categories;
-    QSqlQuery query(db);
-    if (type.isEmpty()) {
-        query.prepare("SELECT id, name, type FROM categories");
-    } else {
-        query.prepare("SELECT id, name, type FROM categories WHERE type = :type");
-        query.bindValue(":type", type);
+    Budget budget = {-1, -1, -1, Money()};
+    const QSharedPointer<QSqlQuery> query = cachedQuery(
+        QStringLiteral("budgets.select"),
+        selectFrom<Budget>("budgets") + " WHERE categoryId = :categoryId AND month = :month");
+    if (!query) {
+        return budget;
     }
+    query->bindValue(":categoryId", categoryId);
+    query->bindValue(":month", month);
 
-    if(query.exec()) {
-        while (query.next()) {
-            Category cat;
-            cat.id = query.value("id").toInt();
-            cat.name = query.value("name").toString();
-            cat.type = query.value("type").toString();
-            categories.append(cat);
+    if (query->exec() && query->next()) {
+        RowSchema<Budget>::decode(*query, budget);
+    }
+    query->finish();
+    return budget;
+}
+
+QList<BudgetReportRow> Database::getBudgetReport(int month)
+{
+    QList<BudgetReportRow> report;
+    const QSharedPointer<QSqlQuery> query = cachedQuery(
+        QStringLiteral("budgets.report"),
+        "SELECT c.id, c.name, b.limit_amount, IFNULL(r.total, 0) FROM categories c "
+        "LEFT JOIN budgets b ON b.categoryId = c.id AND b.month = :budgetMonth "
+        "LEFT JOIN spend_rollup r ON r.categoryId = c.id AND r.month = :spendMonth "
+        "AND r.type = 'Expense' "
+        "WHERE c.type = 'Expense' ORDER BY c.id");
+    if (!query) {
+        return report;
+    }
+    query->bindValue(":budgetMonth", month);
+    query->bindValue(":spendMonth", month);
+
+    if (!query->exec()) {
+        qCritical() << "Failed to build budget report:" << query->lastError().text();
+        return report;
+    }
+    while (query->next()) {
+        BudgetReportRow row;
+        row.categoryId = query->value(0).toInt();
+        row.categoryName = query->value(1).toString();
+        if (!query->value(2).isNull()) {
+            row.limit = Money::fromMinor(query->value(2).toLongLong());
         }
-    } else {
-        qCritical() << "Failed to get categories:" << query.lastError().text();
+        row.spent = Money::fromMinor(query->value(3).toLongLong());
+        report.append(row);
     }
-    return categories;
+    query->finish();
+    return report;
 }
 
-bool Database::setBudget(const Budget &budget)
+std::optional<qint64> Database::writeGeneration()
 {
-    QSqlQuery query(db);
-    // Use INSERT OR REPLACE to handle both new and existing budgets
-    query.prepare("INSERT OR REPLACE INTO budgets (categoryId, month, limit_amount) "
-                  "VALUES (:categoryId, :month, :limit_amount)");
-    query.bindValue(":categoryId", budget.categoryId);
-    query.bindValue(":month", budget.month);
-    query.bindValue(":limit_amount", budget.limit);
+    const QSharedPointer<QSqlQuery> query = cachedQuery(
+        QStringLiteral("ledgerState.selectGeneration"),
+        "SELECT writeGeneration FROM ledger_state WHERE id = 1");
+    if (!query) {
+        return std::nullopt;
+    }
+    if (!query->exec() || !query->next()) {
+        qCritical() << "Failed to read write generation:" << query->lastError().text();
+        return std::nullopt;
+    }
+    const qint64 generation = query->value(0).toLongLong();
+    query->finish();
+    return generation;
+}
 
-    if (!query.exec()) {
-        qCritical() << "Failed to set budget:" << query.lastError().text();
+bool Database::bumpWriteGeneration(qint64 &before)
+{
+    const std::optional<qint64> current = writeGeneration();
+    if (!current) {
+        return false;
+    }
+    const QSharedPointer<QSqlQuery> query = cachedQuery(
+        QStringLiteral("ledgerState.bumpGeneration"),
+        "UPDATE ledger_state SET writeGeneration = writeGeneration + 1 WHERE id = 1");
+    if (!query) {
+        return false;
+    }
+    if (!query->exec() || query->numRowsAffected() != 1) {
+        qCritical() << "Failed to bump write generation:" << query->lastError().text();
         return false;
     }
+    before = *current;
     return true;
 }
 
-Budget Database::getBudget(int categoryId, int month)
+StatementCacheStats Database::statementCacheStats() const
 {
-    Budget budget = {-1, -1, -1, 0.0};
-    QSqlQuery query(db);
-    query.prepare("SELECT id, limit_amount FROM budgets WHERE categoryId = :categoryId AND month = :month");
-    query.bindValue(":categoryId", categoryId);
-    query.bindValue(":month", month);
+    StatementCacheStats stats = cacheStats;
+    stats.cached = statementCache.size();
+    return stats;
+}
 
-    if (query.exec() && query.next()) {
-        budget.id = query.value("id").toInt();
-        budget.categoryId = categoryId;
-        budget.month = month;
-        budget.limit = query.value("limit_amount").toDouble();
+QSharedPointer<QSqlQuery> Database::cachedQuery(const QString &id, const QString &sql)
+{
+    // object() also marks the statement as the most recently used.
+    if (const QSharedPointer<QSqlQuery> *cached = statementCache.object(id)) {
+        ++cacheStats.hits;
+        return *cached;
+    }
+
+    ++cacheStats.misses;
+    QSharedPointer<QSqlQuery> query(new QSqlQuery(db));
+    // Results are only ever stepped once, so QtSql need not buffer rows for
+    // backward seeks.
+    query->setForwardOnly(true);
+    if (!query->prepare(sql)) {
+        qCritical() << "Failed to prepare statement" << id << ":" << query->lastError().text();
+        return QSharedPointer<QSqlQuery>();
+    }
+    // An evicted statement stays alive while a caller still holds it.
+    statementCache.insert(id, new QSharedPointer<QSqlQuery>(query));
+    return query;
+}
+
+void Database::clearStatementCache()
+{
+    // Prepared statements must be finalized before their connection closes
+    // or its schema changes underneath them.
+    statementCache.clear();
+}
+
+void Database::dropCachedStatements(const QString &schema)
+{
+    const QString prefix = schema + QChar('.');
+    const QList<QString> ids = statementCache.keys();
+    for (const QString &id : ids) {
+        const QSharedPointer<QSqlQuery> *cached = statementCache.object(id);
+        if (cached && (*cached)->lastQuery().contains(prefix)) {
+            statementCache.remove(id);
+        }
     }
-    return budget;
 }
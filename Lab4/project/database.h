@@ -5,12 +5,29 @@
 #include <QSqlDatabase>
 #include <QString>
 #include <QList>
+#include <QPair>
 #include <QDateTime>
+#include <QVariant>
+#include <QTimer>
+#include <QHash>
+#include <QCache>
+#include <QSharedPointer>
+#include <QScopedPointer>
+#include <QVector>
+#include <functional>
+#include <limits>
+#include <optional>
+
+#include "money.h"
+
+class QSqlQuery;
+class ColumnStore;
+class SpendCube;
 
 // Corresponds to domain.Transaction
 struct Transaction {
     int id;
-    double amount;
+    Money amount;
     QString type; // "Income", "Expense", "Transfer"
     int categoryId;
     int accountId;
@@ -23,7 +40,7 @@ struct Account {
     int id;
     QString name;
     QString type;
-    double balance;
+    Money balance;
 };
 
 // Corresponds to domain.Category
@@ -38,7 +55,154 @@ struct Budget {
     int id;
     int categoryId;
     int month; // YYYYMM format
-    double limit;
+    Money limit;
+};
+
+// Typed filter for Database::findTransactions(). Unset members do not
+// constrain the result. The query compiles to a parameterized statement that
+// is cached by shape, so repeated filters with new values reuse one plan.
+struct TransactionQuery {
+    enum class Order {
+        NewestFirst,
+        OldestFirst,
+    };
+
+    QDateTime from;                   // inclusive; invalid = unbounded
+    QDateTime to;                     // exclusive; invalid = unbounded
+    QList<int> accountIds;            // empty = any account
+    QList<int> categoryIds;           // empty = any category
+    QString type;                     // empty = any type
+    std::optional<Money> minAmount;   // inclusive
+    std::optional<Money> maxAmount;   // inclusive
+    QString noteContains;             // literal substring, case-insensitive for ASCII
+    QString notePrefix;               // literal prefix, case-insensitive for ASCII
+    Order order = Order::NewestFirst;
+    int limit = 0;                    // <= 0 = no limit
+};
+
+// Position of a row in (time, id) order, used as a keyset pagination cursor.
+struct TransactionCursor {
+    QDateTime time;
+    int id = -1;
+
+    bool isValid() const { return id >= 0 && time.isValid(); }
+};
+
+enum class PageDirection {
+    Forward,   // rows after the cursor, in the query's order
+    Backward,  // rows before the cursor
+};
+
+struct TransactionPage {
+    QList<Transaction> rows;   // always in the query's order
+    TransactionCursor first;   // cursor of rows.first(); pass with Backward
+    TransactionCursor last;    // cursor of rows.last(); pass with Forward
+    bool hasMore = false;      // further rows exist in the requested direction
+};
+
+// SQLite connection tuning applied by Database::init(). A default-constructed
+// value keeps SQLite's own defaults (synchronous=FULL) and leaves the file's
+// journal mode as it is, which is a rollback journal for a new file.
+struct DatabaseOptions {
+    QString journalMode;                            // DELETE, TRUNCATE, PERSIST, MEMORY, WAL, OFF; empty keeps the file's
+    QString synchronous = QStringLiteral("FULL");   // OFF, NORMAL, FULL, EXTRA
+    int cacheSizeKiB = 2000;                        // page cache budget
+    qint64 mmapSize = 0;                            // bytes; 0 disables memory-mapped I/O
+    bool tempStoreMemory = false;                   // temp tables and indices kept in RAM
+    int idleCheckpointMs = 0;                       // WAL only; 0 leaves checkpoints to SQLite
+    bool readOnly = false;                          // QSQLITE_OPEN_READONLY; no migrations, see ReadPool
+
+    // Rollback journal and every commit fsynced; readers block while a
+    // write is running.
+    static DatabaseOptions durable();
+    // WAL + synchronous=NORMAL: readers never block the writer and a commit
+    // costs no fsync; the WAL is checkpointed once the ledger goes idle.
+    static DatabaseOptions balanced();
+    // For imports and reports: balanced plus a large cache, mmap and
+    // in-memory temp storage.
+    static DatabaseOptions bulk();
+};
+
+// One line of the budget view: an expense category, its limit for the
+// month if one is set, and what was spent in that month.
+struct BudgetReportRow {
+    int categoryId;
+    QString categoryName;
+    std::optional<Money> limit;
+    Money spent;
+};
+
+// A (categoryId, month, type) cell of the spend rollup whose stored totals
+// disagree with the transactions table.
+struct RollupDrift {
+    int categoryId;
+    int month;
+    QString type;
+    Money storedTotal;
+    Money actualTotal;
+    qint64 storedCount;
+    qint64 actualCount;
+};
+
+// An account whose stored balance disagrees with its opening balance plus
+// the effect of its transactions.
+struct BalanceDrift {
+    int accountId;
+    Money storedBalance;
+    Money expectedBalance;
+};
+
+// Dimensions a report can group transactions by; see
+// Database::aggregateTransactions().
+enum ReportDimension {
+    ByCategory = 0x1,
+    ByAccount = 0x2,
+    ByType = 0x4,
+    ByMonth = 0x8,
+    AllDimensions = ByCategory | ByAccount | ByType | ByMonth,
+};
+
+// One group of a report. Dimensions not grouped by are 0 (or an empty
+// type); a row without a category has categoryId 0.
+struct ReportRow {
+    int categoryId;
+    int accountId;
+    QString type;
+    int month;
+    Money total;
+    qint64 count;
+};
+
+// A closed year moved out of the main file by Database::archiveYear().
+struct ArchivePartition {
+    int year;
+    QString fileName; // in the main file's directory; old years may share one
+    qint64 fromMs;    // the UTC year, [fromMs, toMs)
+    qint64 toMs;
+    qint64 rowCount;
+};
+
+// Where a Database::backupTo() run has got to.
+struct BackupProgress {
+    qint64 bytesCopied = 0;
+    qint64 totalBytes = 0; // an estimate until the run finishes
+    qint64 elapsedMs = 0;
+
+    double bytesPerSecond() const { return elapsedMs > 0 ? bytesCopied * 1000.0 / elapsedMs : 0.0; }
+};
+
+// A transaction found by Database::searchNotes().
+struct NoteMatch {
+    Transaction transaction;
+    QString snippet; // excerpt of the note with matched words wrapped in [ ]
+    double score;    // bm25 relevance, lower is better; 0 without the index
+};
+
+// Counters of Database's per-connection prepared statement cache.
+struct StatementCacheStats {
+    quint64 hits = 0;
+    quint64 misses = 0;
+    int cached = 0; // statements prepared right now
 };
 
 class Database : public QObject
@@ -50,33 +214,249 @@ public:
 
     bool init();
     bool init(const QString &dbFilePath);
+    bool init(const DatabaseOptions &options);
+    bool init(const QString &dbFilePath, const DatabaseOptions &options);
+    // The main file passed to init(); empty before.
+    QString filePath() const;
+
+    // Settings currently in effect, read back from the connection's PRAGMAs.
+    DatabaseOptions activeOptions();
+
+    // Schema version stored in PRAGMA user_version (-1 if unreadable).
+    int schemaVersion();
+    static int latestSchemaVersion();
 
     // Transaction management
     bool addTransaction(Transaction &tx);
+    // Inserts the whole batch in one SQL transaction, all or nothing. On
+    // success each element's id is set; on failure every id is reset to -1.
+    bool addTransactions(QList<Transaction> &txs);
+    // Group commit: each element goes in all or nothing on its own, exactly
+    // as with addTransaction(), but the batch shares a single commit.
+    // applied[i] tells whether txs[i] went in; ids of the others are -1.
+    // Returns false if the batch could not be committed, and then nothing
+    // was applied.
+    bool addTransactionGroup(QList<Transaction> &txs, QVector<bool> &applied);
     bool deleteTransaction(int id);
     bool updateTransaction(const Transaction &tx);
+    QList<Transaction> findTransactions(const TransactionQuery &query);
+    // Keyset pagination: up to pageSize rows strictly beyond cursor. An
+    // invalid cursor starts from the first (Forward) or last (Backward) row.
+    // Pages stay stable when rows are inserted concurrently. query.limit is
+    // ignored.
+    TransactionPage findTransactionsPage(const TransactionQuery &query,
+                                         const TransactionCursor &cursor,
+                                         int pageSize,
+                                         PageDirection direction = PageDirection::Forward);
+    // Streams the rows matching query to visitor one at a time, decoded into
+    // a single reused buffer, so memory stays flat however many rows match.
+    // Returning false from visitor stops the scan. Returns false on SQL error.
+    bool forEachTransaction(const TransactionQuery &query,
+                            const std::function<bool(const Transaction &)> &visitor);
+    // Number of rows matching query, counted from the indexes.
+    int countTransactions(const TransactionQuery &query);
+    // Ranked full-text search over notes. Every word in terms must occur,
+    // each matched as a prefix ("groc" finds "Groceries"). Served by an
+    // FTS5 index when SQLite has FTS5; otherwise by a LIKE scan, newest
+    // first, which is correct but reads every note.
+    QList<NoteMatch> searchNotes(const QString &terms, int limit = 50);
+    bool hasNoteIndex() const;
+    // Legacy form: filter is pasted verbatim after WHERE. Prefer the
+    // TransactionQuery overload, which is parameterized and cached. Note
+    // that time is stored as epoch milliseconds, month as YYYYMM and amount
+    // in minor units.
     QList<Transaction> findTransactions(const QString &filter);
-    double calculateSpent(int categoryId, int month);
+    // Point lookup in the spend rollup, which every transaction write keeps
+    // current in the same SQL transaction.
+    Money calculateSpent(int categoryId, int month);
+
+    // Recomputes the spend rollup from the transactions table and returns
+    // the cells that differ; empty means consistent.
+    QList<RollupDrift> verifySpendRollup();
+    // Replaces the spend rollup with one recomputed from scratch.
+    bool rebuildSpendRollup();
+
+    // Sums and counts of the transactions with time in [fromMs, toMs),
+    // archived ones included, grouped by the ReportDimension flags in
+    // dimensions and ordered by the grouped columns, or nullopt if they
+    // could not be read. See ReportEngine for the parallel form.
+    std::optional<QList<ReportRow>> aggregateTransactions(qint64 fromMs, qint64 toMs,
+                                                          int dimensions = AllDimensions);
+    // Times of the earliest and latest transaction, {0, -1} if there are
+    // none, or nullopt if they could not be read.
+    std::optional<QPair<qint64, qint64>> transactionTimeSpan();
 
     // Account management
     bool addAccount(Account &acc);
     bool updateAccount(const Account &acc);
     QList<Account> getAllAccounts();
-    bool updateBalance(int accountId, double amount);
+    bool updateBalance(int accountId, Money amount);
+    // Recomputes the balances of accounts with fromAccountId <= id <
+    // toAccountId from the transaction log and returns those that differ,
+    // or nullopt if they could not be read. Each account is checked within
+    // one statement, so concurrent writes never show up as drift. See
+    // BalanceVerifier for the parallel form.
+    std::optional<QList<BalanceDrift>> verifyBalances(int fromAccountId = 0,
+                                                      int toAccountId = std::numeric_limits<int>::max());
+    // Resets the given accounts' balances to the recomputed value, all in
+    // one SQL transaction.
+    bool repairBalances(const QList<int> &accountIds);
+    // The account's balance from every transaction before at, or nullopt
+    // for an unknown account. Starts from the latest balance checkpoint at
+    // or before at and sums only the rows after it.
+    std::optional<Money> balanceAsOf(int accountId, const QDateTime &at);
+    // Adds per-account checkpoints at each UTC month start up to upTo's
+    // month, continuing from the latest valid one. Writes that touch rows
+    // before a checkpoint drop it, and the next refresh puts it back.
+    bool refreshBalanceCheckpoints(const QDateTime &upTo = QDateTime::currentDateTimeUtc());
 
     // Category management
     bool addCategory(Category &cat);
     QList<Category> getAllCategories(const QString &type);
 
+    // O(1) lookups served from in-memory copies of the accounts and
+    // categories tables. Each is loaded on first use and kept current by
+    // this object's own writes; a rolled back transaction drops them.
+    std::optional<Account> account(int id);
+    QString categoryName(int id); // empty if id is unknown
+
     // Budget management
     bool setBudget(const Budget &budget);
     Budget getBudget(int categoryId, int month);
+    // Every expense category with its budget and spend for month, read in
+    // a single statement.
+    QList<BudgetReportRow> getBudgetReport(int month);
+
+    // Moves every transaction of a closed UTC year into <name>-<year>.db
+    // next to the ledger file, which keeps the main file and its indexes
+    // to the years still in use. Running it again for the same year moves
+    // rows backdated into it since. Once there are more archive files than
+    // SQLite can attach at once, the oldest are folded together, so the
+    // earliest file may hold several years (see
+    // ArchivePartition::fileName). Reads that take a time range
+    // (findTransactions, findTransactionsPage, forEachTransaction,
+    // countTransactions, balanceAsOf) ATTACH and read the archives their
+    // range overlaps; spend and budget figures come from the spend rollup,
+    // which keeps counting archived rows. Archived rows are read-only, and
+    // searchNotes() and the string filter overload see the main file only.
+    bool archiveYear(int year);
+    QList<ArchivePartition> archivePartitions() const;
+
+    // Writes a consistent copy of the ledger to path, plus each archive
+    // under its own file name next to it, with VACUUM INTO on a background
+    // read-only connection. Under WAL that connection only holds a read
+    // snapshot, so writers carry on throughout; in the other journal modes
+    // they wait for the copy. The calling thread waits too, so a writer
+    // should use AsyncDatabase::backupTo(), which runs this off its thread.
+    // progress is called on the calling thread every few milliseconds and
+    // once at the end. The target files must not exist yet.
+    bool backupTo(const QString &path,
+                  const std::function<void(const BackupProgress &)> &progress = nullptr);
+
+    // Loads every transaction, archived ones included, into an in-memory
+    // ColumnStore for analytics. From then on each committed write through
+    // this object is applied to it as well; writes through other
+    // connections are only seen by the next load.
+    bool loadColumnStore();
+    const ColumnStore *columnStore() const; // nullptr until loaded
+
+    // Fills a SpendCube with every transaction, archived ones included,
+    // and keeps it current on each committed write through this object,
+    // like the column store. With a cachePath the cube saved there is used
+    // instead when it was saved at the current writeGeneration() and still
+    // agrees with spend_rollup and the account balances; otherwise it is
+    // rebuilt and saved there again.
+    bool loadSpendCube(const QString &cachePath = QString());
+    bool saveSpendCube(const QString &path) const;
+    const SpendCube *spendCube() const; // nullptr until loaded
+
+    // Number of committed writes to the transactions so far, through any
+    // connection; nullopt if unreadable.
+    std::optional<qint64> writeGeneration();
+
+    StatementCacheStats statementCacheStats() const;
+
+    // Holds one read snapshot until endSnapshot(), so every read in between
+    // sees the same committed state. Meant for read-only connections; under
+    // WAL it does not block the writer.
+    bool beginSnapshot();
+    void endSnapshot();
 
 
 private:
-    void createTables();
+    bool migrateSchema();
+    // Creates the FTS5 note index if SQLite supports it. Never fails init.
+    void ensureNoteIndex();
+    bool noteIndexComplete();
+    QList<NoteMatch> searchNotesByLike(const QStringList &words, int limit);
+    bool insertTransactionRow(Transaction &tx);
+    // Row, spend rollup and balance of one new transaction; the caller owns
+    // the SQL transaction.
+    bool applyNewTransaction(Transaction &tx);
+    // Adds total and count to one spend rollup cell, creating it if needed.
+    bool applySpendRollup(int categoryId, int month, const QString &type, Money total, qint64 count);
+    bool loadPartitions();
+    // Sanity check of a saved cube: its per-category cells against
+    // spend_rollup and its per-account deltas against balances.
+    bool spendCubeMatchesTables(const SpendCube &saved);
+    // Advances the write generation inside the caller's SQL transaction;
+    // before receives the generation it had.
+    bool bumpWriteGeneration(qint64 &before);
+    // FROM-clause source of the transactions in [fromMs, toMs): the main
+    // table alone, or a UNION ALL of it with the overlapping archives,
+    // which are attached as needed. Empty if one cannot be attached. Call
+    // outside SQL transactions, since ATTACH cannot run inside one. key, if
+    // given, receives the archived years read (empty for the main table
+    // alone), which names the source in statement cache ids.
+    QString transactionSource(qint64 fromMs, qint64 toMs, QString *key = nullptr);
+    // Attaches fileName as schema unless it already is, detaching the least
+    // recently used archive not listed in keep if the limit is reached.
+    bool attachArchive(const QString &schema, const QString &fileName, const QStringList &keep);
+    bool detachArchive(const QString &schema);
+    // Folds the second-oldest archive file into the oldest until no more
+    // files remain than can be attached at once, so that every range can
+    // be read in one statement.
+    bool consolidateArchives();
+    // Drops the account's balance checkpoints that include a row at timeMs.
+    bool invalidateCheckpoints(int accountId, qint64 timeMs);
+    bool applyOptions(const DatabaseOptions &options);
+    void scheduleIdleCheckpoint();
+    void checkpointWal();
+    // Returns the statement registered under id, preparing sql on first use.
+    // Null if the statement cannot be prepared (e.g. connection not open).
+    // The least recently used statements are finalized beyond
+    // kMaxCachedStatements.
+    QSharedPointer<QSqlQuery> cachedQuery(const QString &id, const QString &sql);
+    void clearStatementCache();
+    // Finalizes the cached statements that read from schema.
+    void dropCachedStatements(const QString &schema);
+    // db.rollback() plus dropping the entity caches, which may hold
+    // balances written inside the aborted transaction.
+    void rollback();
+    void invalidateEntityCaches();
+    bool ensureAccountCache();
+    bool ensureCategoryCache();
+    // Read-only connections: drops the entity caches once another
+    // connection has committed since they were loaded.
+    void dropStaleEntityCaches();
+    QSharedPointer<QSqlQuery> execTransactionQuery(const QString &shape, const QString &sql,
+                                                   const QVariantList &binds);
     QSqlDatabase db;
     QString connectionName;
+    DatabaseOptions options;
+    QTimer checkpointTimer;
+    QCache<QString, QSharedPointer<QSqlQuery>> statementCache;
+    StatementCacheStats cacheStats;
+    QHash<int, Account> accountCache;
+    QHash<int, Category> categoryCache;
+    bool accountCacheLoaded = false;
+    bool categoryCacheLoaded = false;
+    qint64 dataVersion = -1;
+    bool noteIndex = false;
+    QList<ArchivePartition> partitions;
+    QStringList attachedPartitions; // schema names, least recently used first
+    QScopedPointer<ColumnStore> columns;
+    QScopedPointer<SpendCube> cube;
 };
 
 #endif // DATABASE_H
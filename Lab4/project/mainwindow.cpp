@@ -3,21 +3,44 @@
 #include <QMessageBox>
 #include <QDebug>
 #include <QInputDialog>
+#include <QScrollBar>
+
+namespace {
+// Rows fetched per page; further pages load as the table is scrolled down.
+const int kTransactionPageSize = 200;
+
+// One page of the transactions table, with everything needed to render it.
+struct TransactionRows {
+    TransactionPage page;
+    QStringList categoryNames; // parallel to page.rows
+    int total = -1;            // only counted for the first page
+};
+
+struct BudgetStatus {
+    double ratio = 0.0; // spent / limit; 0 when no limit is set
+    QString categoryName;
+};
+}
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
 {
     ui->setupUi(this);
-
-    if (!m_db.init()) {
-        QMessageBox::critical(this, "Error", "Failed to initialize database. The application will close.");
-        QApplication::quit();
-        return;
-    }
-
     setupUiElements();
-    loadInitialData();
+
+    // All SQL runs on m_db's worker thread; results come back to the
+    // handlers below, so the window never blocks on the database.
+    AsyncDatabase::whenFinished(this, m_db.init(DatabaseOptions::balanced()), [this](bool ok) {
+        if (!ok) {
+            QMessageBox::critical(this, "Error", "Failed to initialize database. The application will close.");
+            QApplication::quit();
+            return;
+        }
+        loadInitialData();
+        // Queued behind the initial reads; keeps "balance as of" lookups short.
+        m_db.run([](Database &db) { return db.refreshBalanceCheckpoints(); });
+    });
 }
 
 MainWindow::~MainWindow()
@@ -37,6 +60,11 @@ void MainWindow::setupUiElements()
     ui->transactionsTable->setHorizontalHeaderLabels({"ID", "Time", "Type", "Category", "Amount", "Note"});
     ui->transactionsTable->setSelectionBehavior(QAbstractItemView::SelectRows);
     ui->transactionsTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    connect(ui->transactionsTable->verticalScrollBar(), &QScrollBar::valueChanged, this, [this](int value) {
+        if (m_hasMoreTransactions && value == ui->transactionsTable->verticalScrollBar()->maximum()) {
+            loadMoreTransactions();
+        }
+    });
 
 
     // Accounts Tab
@@ -66,104 +94,154 @@ void MainWindow::loadInitialData()
 
 void MainWindow::refreshTransactionView()
 {
-    m_currentTransactions = m_db.findTransactions("");
-    ui->transactionsTable->setRowCount(m_currentTransactions.size());
-
-    int row = 0;
-    for (const auto &tx : m_currentTransactions) {
-        ui->transactionsTable->setItem(row, 0, new QTableWidgetItem(QString::number(tx.id)));
-        ui->transactionsTable->setItem(row, 1, new QTableWidgetItem(tx.time.toString("yyyy-MM-dd hh:mm")));
-        ui->transactionsTable->setItem(row, 2, new QTableWidgetItem(tx.type));
-        
-        // Get category name from ID
-        QList<Category> cats = m_db.getAllCategories("");
-        QString catName = "N/A";
-        for(const auto& cat : cats){
-            if(cat.id == tx.categoryId) {
-                catName = cat.name;
-                break;
+    // A new generation makes pages still in flight for the old view stale.
+    ++m_transactionGeneration;
+    m_loadingTransactions = false;
+    m_currentTransactions.clear();
+    m_transactionCursor = TransactionCursor();
+    m_hasMoreTransactions = false;
+    m_totalTransactions = 0;
+    ui->transactionsTable->setRowCount(0);
+    loadMoreTransactions();
+}
+
+void MainWindow::loadMoreTransactions()
+{
+    if (m_loadingTransactions) {
+        return;
+    }
+    m_loadingTransactions = true;
+
+    const int generation = m_transactionGeneration;
+    const TransactionCursor cursor = m_transactionCursor;
+    // Category names are resolved on the worker, next to its category cache.
+    const QFuture<TransactionRows> rows = m_db.run([cursor](Database &db) {
+        TransactionRows result;
+        result.page = db.findTransactionsPage(TransactionQuery(), cursor, kTransactionPageSize);
+        for (const Transaction &tx : result.page.rows) {
+            result.categoryNames << db.categoryName(tx.categoryId);
+        }
+        if (!cursor.isValid()) {
+            result.total = db.countTransactions(TransactionQuery());
+        }
+        return result;
+    });
+
+    AsyncDatabase::whenFinished(this, rows, [this, generation](const TransactionRows &result) {
+        if (generation != m_transactionGeneration) {
+            return;
+        }
+        m_loadingTransactions = false;
+
+        const TransactionPage &page = result.page;
+        const bool firstPage = !m_transactionCursor.isValid();
+        if (result.total >= 0) {
+            m_totalTransactions = result.total;
+        }
+        m_transactionCursor = page.rows.isEmpty() ? m_transactionCursor : page.last;
+        m_hasMoreTransactions = page.hasMore;
+
+        int row = m_currentTransactions.size();
+        m_currentTransactions.append(page.rows);
+        ui->transactionsTable->setRowCount(m_currentTransactions.size());
+
+        for (int i = 0; i < page.rows.size(); ++i) {
+            const Transaction &tx = page.rows.at(i);
+            ui->transactionsTable->setItem(row, 0, new QTableWidgetItem(QString::number(tx.id)));
+            ui->transactionsTable->setItem(row, 1, new QTableWidgetItem(tx.time.toString("yyyy-MM-dd hh:mm")));
+            ui->transactionsTable->setItem(row, 2, new QTableWidgetItem(tx.type));
+
+            QString catName = result.categoryNames.value(i);
+            if (catName.isEmpty()) {
+                catName = "N/A";
             }
+            ui->transactionsTable->setItem(row, 3, new QTableWidgetItem(catName));
+            ui->transactionsTable->setItem(row, 4, new QTableWidgetItem(tx.amount.toString()));
+            ui->transactionsTable->setItem(row, 5, new QTableWidgetItem(tx.note));
+            row++;
         }
-        ui->transactionsTable->setItem(row, 3, new QTableWidgetItem(catName));
-        ui->transactionsTable->setItem(row, 4, new QTableWidgetItem(QString::number(tx.amount, 'f', 2)));
-        ui->transactionsTable->setItem(row, 5, new QTableWidgetItem(tx.note));
-        row++;
-    }
-    ui->transactionsTable->resizeColumnsToContents();
+        if (firstPage) {
+            ui->transactionsTable->resizeColumnsToContents();
+        }
+        statusBar()->showMessage(QString("Showing %1 of %2 transactions")
+                                 .arg(m_currentTransactions.size())
+                                 .arg(m_totalTransactions));
+    });
 }
 
 void MainWindow::refreshAccountView()
 {
-    QList<Account> accounts = m_db.getAllAccounts();
-    ui->accountsTable->setRowCount(accounts.size());
-    ui->accountComboBox->clear();
-
-    int row = 0;
-    for (const auto &acc : accounts) {
-        ui->accountsTable->setItem(row, 0, new QTableWidgetItem(QString::number(acc.id)));
-        ui->accountsTable->setItem(row, 1, new QTableWidgetItem(acc.name));
-        ui->accountsTable->setItem(row, 2, new QTableWidgetItem(QString::number(acc.balance, 'f', 2)));
-        ui->accountComboBox->addItem(acc.name, acc.id);
-        row++;
-    }
-    ui->accountsTable->resizeColumnsToContents();
+    AsyncDatabase::whenFinished(this, m_db.getAllAccounts(), [this](const QList<Account> &accounts) {
+        ui->accountsTable->setRowCount(accounts.size());
+        ui->accountComboBox->clear();
+
+        int row = 0;
+        for (const auto &acc : accounts) {
+            ui->accountsTable->setItem(row, 0, new QTableWidgetItem(QString::number(acc.id)));
+            ui->accountsTable->setItem(row, 1, new QTableWidgetItem(acc.name));
+            ui->accountsTable->setItem(row, 2, new QTableWidgetItem(acc.balance.toString()));
+            ui->accountComboBox->addItem(acc.name, acc.id);
+            row++;
+        }
+        ui->accountsTable->resizeColumnsToContents();
+    });
 }
 
 void MainWindow::refreshCategoryView()
 {
-    QList<Category> categories = m_db.getAllCategories("");
-    ui->categoriesTable->setRowCount(categories.size());
-    ui->budgetCategoryBox->clear();
-
-    int row = 0;
-    for (const auto &cat : categories) {
-        ui->categoriesTable->setItem(row, 0, new QTableWidgetItem(QString::number(cat.id)));
-        ui->categoriesTable->setItem(row, 1, new QTableWidgetItem(cat.name));
-        ui->categoriesTable->setItem(row, 2, new QTableWidgetItem(cat.type));
-        if (cat.type == "Expense") {
-            ui->budgetCategoryBox->addItem(cat.name, cat.id);
+    AsyncDatabase::whenFinished(this, m_db.getAllCategories(""), [this](const QList<Category> &categories) {
+        ui->categoriesTable->setRowCount(categories.size());
+        ui->budgetCategoryBox->clear();
+
+        int row = 0;
+        for (const auto &cat : categories) {
+            ui->categoriesTable->setItem(row, 0, new QTableWidgetItem(QString::number(cat.id)));
+            ui->categoriesTable->setItem(row, 1, new QTableWidgetItem(cat.name));
+            ui->categoriesTable->setItem(row, 2, new QTableWidgetItem(cat.type));
+            if (cat.type == "Expense") {
+                ui->budgetCategoryBox->addItem(cat.name, cat.id);
+            }
+            row++;
         }
-        row++;
-    }
-    ui->categoriesTable->resizeColumnsToContents();
-    populateCategoryComboBox(ui->transactionTypeBox->currentText());
+        ui->categoriesTable->resizeColumnsToContents();
+        populateCategoryComboBox(ui->transactionTypeBox->currentText());
+    });
 }
 
 void MainWindow::refreshBudgetView()
 {
     int month = ui->budgetMonthEdit->date().toString("yyyyMM").toInt();
-    QList<Category> expenseCategories = m_db.getAllCategories("Expense");
-    ui->budgetsTable->setRowCount(expenseCategories.size());
-
-    int row = 0;
-    for (const auto& cat : expenseCategories) {
-        Budget budget = m_db.getBudget(cat.id, month);
-        double spent = m_db.calculateSpent(cat.id, month);
-
-        ui->budgetsTable->setItem(row, 0, new QTableWidgetItem(cat.name));
-        ui->budgetsTable->setItem(row, 1, new QTableWidgetItem(QString::number(month)));
-        ui->budgetsTable->setItem(row, 2, new QTableWidgetItem(budget.id != -1 ? QString::number(budget.limit, 'f', 2) : "Not Set"));
-        ui->budgetsTable->setItem(row, 3, new QTableWidgetItem(QString::number(spent, 'f', 2)));
-        row++;
-    }
-    ui->budgetsTable->resizeColumnsToContents();
+    AsyncDatabase::whenFinished(this, m_db.getBudgetReport(month), [this, month](const QList<BudgetReportRow> &report) {
+        ui->budgetsTable->setRowCount(report.size());
+
+        int row = 0;
+        for (const auto& line : report) {
+            ui->budgetsTable->setItem(row, 0, new QTableWidgetItem(line.categoryName));
+            ui->budgetsTable->setItem(row, 1, new QTableWidgetItem(QString::number(month)));
+            ui->budgetsTable->setItem(row, 2, new QTableWidgetItem(line.limit ? line.limit->toString() : "Not Set"));
+            ui->budgetsTable->setItem(row, 3, new QTableWidgetItem(line.spent.toString()));
+            row++;
+        }
+        ui->budgetsTable->resizeColumnsToContents();
+    });
 }
 
 
 void MainWindow::populateCategoryComboBox(const QString& type)
 {
-    ui->categoryComboBox->clear();
-    QList<Category> categories = m_db.getAllCategories(type);
-    for (const auto &cat : categories) {
-        ui->categoryComboBox->addItem(cat.name, cat.id);
-    }
+    AsyncDatabase::whenFinished(this, m_db.getAllCategories(type), [this](const QList<Category> &categories) {
+        ui->categoryComboBox->clear();
+        for (const auto &cat : categories) {
+            ui->categoryComboBox->addItem(cat.name, cat.id);
+        }
+    });
 }
 
 void MainWindow::on_addTransactionButton_clicked()
 {
     Transaction tx;
-    tx.amount = ui->amountSpinBox->value();
-    if (tx.amount <= 0) {
+    tx.amount = Money::fromDouble(ui->amountSpinBox->value());
+    if (tx.amount <= Money()) {
         QMessageBox::warning(this, "Invalid Input", "Amount must be positive.");
         return;
     }
@@ -182,7 +260,11 @@ void MainWindow::on_addTransactionButton_clicked()
         return;
     }
 
-    if (m_db.addTransaction(tx)) {
+    AsyncDatabase::whenFinished(this, m_db.addTransaction(tx), [this, tx](int id) {
+        if (id < 0) {
+            QMessageBox::critical(this, "Error", "Failed to add transaction.");
+            return;
+        }
         QMessageBox::information(this, "Success", "Transaction added successfully.");
         refreshTransactionView();
         refreshAccountView();
@@ -193,9 +275,7 @@ void MainWindow::on_addTransactionButton_clicked()
         // clear inputs
         ui->amountSpinBox->setValue(0);
         ui->noteLineEdit->clear();
-    } else {
-        QMessageBox::critical(this, "Error", "Failed to add transaction.");
-    }
+    });
 }
 
 void MainWindow::on_transactionTypeBox_currentIndexChanged(int index)
@@ -208,21 +288,23 @@ void MainWindow::on_addAccountButton_clicked()
     Account acc;
     acc.name = ui->accountNameEdit->text();
     acc.type = ui->accountTypeBox->currentText();
-    acc.balance = ui->initialBalanceSpinBox->value();
+    acc.balance = Money::fromDouble(ui->initialBalanceSpinBox->value());
 
     if (acc.name.isEmpty()) {
         QMessageBox::warning(this, "Invalid Input", "Account name cannot be empty.");
         return;
     }
 
-    if (m_db.addAccount(acc)) {
+    AsyncDatabase::whenFinished(this, m_db.addAccount(acc), [this](int id) {
+        if (id < 0) {
+            QMessageBox::critical(this, "Error", "Failed to add account. Does it already exist?");
+            return;
+        }
         QMessageBox::information(this, "Success", "Account added successfully.");
         refreshAccountView();
         ui->accountNameEdit->clear();
         ui->initialBalanceSpinBox->setValue(0);
-    } else {
-        QMessageBox::critical(this, "Error", "Failed to add account. Does it already exist?");
-    }
+    });
 }
 
 void MainWindow::on_addCategoryButton_clicked()
@@ -236,14 +318,16 @@ void MainWindow::on_addCategoryButton_clicked()
         return;
     }
 
-    if (m_db.addCategory(cat)) {
+    AsyncDatabase::whenFinished(this, m_db.addCategory(cat), [this](int id) {
+        if (id < 0) {
+            QMessageBox::critical(this, "Error", "Failed to add category. Does it already exist?");
+            return;
+        }
         QMessageBox::information(this, "Success", "Category added successfully.");
         refreshCategoryView();
         refreshBudgetView(); // New categories might need a budget
         ui->categoryNameEdit->clear();
-    } else {
-        QMessageBox::critical(this, "Error", "Failed to add category. Does it already exist?");
-    }
+    });
 }
 
 void MainWindow::on_setBudgetButton_clicked()
@@ -251,46 +335,48 @@ void MainWindow::on_setBudgetButton_clicked()
     Budget budget;
     budget.categoryId = ui->budgetCategoryBox->currentData().toInt();
     budget.month = ui->budgetMonthEdit->date().toString("yyyyMM").toInt();
-    budget.limit = ui->budgetLimitSpinBox->value();
+    budget.limit = Money::fromDouble(ui->budgetLimitSpinBox->value());
 
     if (budget.categoryId == 0) {
         QMessageBox::warning(this, "Invalid Input", "Please select a category for the budget.");
         return;
     }
-    if (budget.limit <= 0) {
+    if (budget.limit <= Money()) {
         QMessageBox::warning(this, "Invalid Input", "Budget limit must be positive.");
         return;
     }
 
-    if (m_db.setBudget(budget)) {
+    AsyncDatabase::whenFinished(this, m_db.setBudget(budget), [this](bool ok) {
+        if (!ok) {
+            QMessageBox::critical(this, "Error", "Failed to set budget.");
+            return;
+        }
         QMessageBox::information(this, "Success", "Budget set successfully.");
         refreshBudgetView();
-    } else {
-        QMessageBox::critical(this, "Error", "Failed to set budget.");
-    }
+    });
 }
 
 void MainWindow::checkBudget(int categoryId)
 {
     int month = QDate::currentDate().toString("yyyyMM").toInt();
-    Budget budget = m_db.getBudget(categoryId, month);
-    if (budget.id != -1 && budget.limit > 0) {
-        double spent = m_db.calculateSpent(categoryId, month);
-        if (spent / budget.limit >= 0.8) {
-            QList<Category> cats = m_db.getAllCategories("");
-            QString catName = "";
-            for(const auto& cat : cats){
-                if(cat.id == categoryId) {
-                    catName = cat.name;
-                    break;
-                }
-            }
+    const QFuture<BudgetStatus> status = m_db.run([categoryId, month](Database &db) {
+        BudgetStatus result;
+        const Budget budget = db.getBudget(categoryId, month);
+        if (budget.id != -1 && budget.limit > Money()) {
+            const Money spent = db.calculateSpent(categoryId, month);
+            result.ratio = double(spent.minor()) / budget.limit.minor();
+            result.categoryName = db.categoryName(categoryId);
+        }
+        return result;
+    });
+    AsyncDatabase::whenFinished(this, status, [this](const BudgetStatus &result) {
+        if (result.ratio >= 0.8) {
             QMessageBox::warning(this, "Budget Alert",
                                  QString("You have spent %1% of your budget for '%2'.")
-                                 .arg(QString::number(spent / budget.limit * 100, 'f', 0))
-                                 .arg(catName));
+                                 .arg(QString::number(result.ratio * 100, 'f', 0))
+                                 .arg(result.categoryName));
         }
-    }
+    });
 }
 
 void MainWindow::on_transactionsTable_cellDoubleClicked(int row, int column)
@@ -314,12 +400,14 @@ void MainWindow::on_transactionsTable_cellDoubleClicked(int row, int column)
             }
         }
         tx.note = newNote;
-        if (m_db.updateTransaction(tx)) {
+        AsyncDatabase::whenFinished(this, m_db.updateTransaction(tx), [this](bool updated) {
+            if (!updated) {
+                QMessageBox::critical(this, "Error", "Failed to update transaction.");
+                return;
+            }
             QMessageBox::information(this, "Success", "Transaction updated.");
             refreshTransactionView();
-        } else {
-            QMessageBox::critical(this, "Error", "Failed to update transaction.");
-        }
+        });
     }
 }
 
@@ -338,13 +426,15 @@ void MainWindow::on_deleteTransactionButton_clicked()
     reply = QMessageBox::question(this, "Confirm Delete", "Are you sure you want to delete this transaction? This will also update the account balance.",
                                   QMessageBox::Yes|QMessageBox::No);
     if (reply == QMessageBox::Yes) {
-        if (m_db.deleteTransaction(txId)) {
+        AsyncDatabase::whenFinished(this, m_db.deleteTransaction(txId), [this](bool deleted) {
+            if (!deleted) {
+                QMessageBox::critical(this, "Error", "Failed to delete transaction.");
+                return;
+            }
             QMessageBox::information(this, "Success", "Transaction deleted.");
             refreshTransactionView();
             refreshAccountView();
             refreshBudgetView();
-        } else {
-            QMessageBox::critical(this, "Error", "Failed to delete transaction.");
-        }
+        });
     }
 }
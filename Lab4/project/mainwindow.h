@@ -2,7 +2,7 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
-#include "database.h"
+#include "asyncdatabase.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -30,6 +30,7 @@ private:
     void setupUiElements();
     void loadInitialData();
     void refreshTransactionView();
+    void loadMoreTransactions();
     void refreshAccountView();
     void refreshCategoryView();
     void refreshBudgetView();
@@ -38,7 +39,12 @@ private:
 
 
     Ui::MainWindow *ui;
-    Database m_db;
+    AsyncDatabase m_db;
     QList<Transaction> m_currentTransactions;
+    TransactionCursor m_transactionCursor;
+    bool m_hasMoreTransactions = false;
+    int m_totalTransactions = 0;
+    bool m_loadingTransactions = false;
+    int m_transactionGeneration = 0;
 };
 #endif // MAINWINDOW_H
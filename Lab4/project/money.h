@@ -0,0 +1,57 @@
+#ifndef MONEY_H
+#define MONEY_H
+
+#include <QChar>
+#include <QString>
+#include <QtGlobal>
+
+#include <cmath>
+
+// An amount of money held as a whole number of minor units (cents). Sums,
+// differences and comparisons are exact integer operations, so balances do
+// not drift however many deltas are applied to them.
+class Money {
+public:
+    static constexpr qint64 MinorPerMajor = 100;
+
+    constexpr Money() = default;
+
+    static constexpr Money fromMinor(qint64 minor) { return Money(minor); }
+    // Rounds to the nearest minor unit, halves away from zero. Meant for
+    // values coming from the UI, not for arithmetic.
+    static Money fromDouble(double major) { return Money(std::llround(major * MinorPerMajor)); }
+
+    constexpr qint64 minor() const { return value; }
+    double toDouble() const { return double(value) / MinorPerMajor; }
+    // Fixed two decimals, e.g. "1234.50" or "-0.05".
+    QString toString() const
+    {
+        const qint64 magnitude = value < 0 ? -value : value;
+        return QString(value < 0 ? "-" : "")
+                + QString::number(magnitude / MinorPerMajor)
+                + QChar('.')
+                + QString::number(magnitude % MinorPerMajor).rightJustified(2, QChar('0'));
+    }
+
+    constexpr bool isZero() const { return value == 0; }
+
+    constexpr Money operator-() const { return Money(-value); }
+    Money &operator+=(Money other) { value += other.value; return *this; }
+    Money &operator-=(Money other) { value -= other.value; return *this; }
+
+    friend constexpr Money operator+(Money a, Money b) { return Money(a.value + b.value); }
+    friend constexpr Money operator-(Money a, Money b) { return Money(a.value - b.value); }
+    friend constexpr bool operator==(Money a, Money b) { return a.value == b.value; }
+    friend constexpr bool operator!=(Money a, Money b) { return a.value != b.value; }
+    friend constexpr bool operator<(Money a, Money b) { return a.value < b.value; }
+    friend constexpr bool operator<=(Money a, Money b) { return a.value <= b.value; }
+    friend constexpr bool operator>(Money a, Money b) { return a.value > b.value; }
+    friend constexpr bool operator>=(Money a, Money b) { return a.value >= b.value; }
+
+private:
+    constexpr explicit Money(qint64 minor) : value(minor) {}
+
+    qint64 value = 0;
+};
+
+#endif // MONEY_H
@@ -0,0 +1,79 @@
+#include "readpool.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <QThread>
+
+ReadPool::ReadPool(const QString &dbFilePath, const DatabaseOptions &options, QObject *parent)
+    : QObject(parent)
+    , path(dbFilePath)
+    , options(options)
+{
+    this->options.readOnly = true;
+    // Readers never write, so there is nothing for them to checkpoint.
+    this->options.idleCheckpointMs = 0;
+}
+
+ReadPool::~ReadPool()
+{
+    QMutexLocker locker(&mutex);
+    for (const Reader &reader : readers) {
+        QObject::disconnect(reader.finishedHook);
+        // A thread whose QThread is gone has exited without a finished
+        // signal (an adopted thread), so nothing can use its reader any more.
+        const bool closable = !reader.thread || reader.thread == QThread::currentThread()
+                || reader.thread->isFinished();
+        Q_ASSERT_X(closable, "ReadPool", "destroyed while a client thread is still running");
+        if (!closable) {
+            qCritical() << "ReadPool destroyed while thread" << reader.thread.data()
+                        << "still runs; leaving its reader open";
+            continue;
+        }
+        delete reader.db;
+    }
+    readers.clear();
+}
+
+Database *ReadPool::reader()
+{
+    QThread *thread = QThread::currentThread();
+    {
+        QMutexLocker locker(&mutex);
+        const auto it = readers.constFind(thread);
+        if (it != readers.constEnd()) {
+            return it.value().db;
+        }
+    }
+
+    // Opened outside the lock so threads do not wait on each other's open.
+    auto *db = new Database;
+    if (!db->init(path, options)) {
+        delete db;
+        return nullptr;
+    }
+    QMutexLocker locker(&mutex);
+    Reader &reader = readers[thread];
+    reader.db = db;
+    reader.thread = thread;
+    // Direct, so the connection is closed on the thread that opened it. The
+    // destructor disconnects it before the pool goes away.
+    reader.finishedHook = connect(thread, &QThread::finished, this, [this, thread]() { closeReader(thread); },
+                                  Qt::DirectConnection);
+    return db;
+}
+
+int ReadPool::size() const
+{
+    QMutexLocker locker(&mutex);
+    return readers.size();
+}
+
+void ReadPool::closeReader(QThread *thread)
+{
+    Database *db = nullptr;
+    {
+        QMutexLocker locker(&mutex);
+        db = readers.take(thread).db;
+    }
+    delete db;
+}
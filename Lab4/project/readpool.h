@@ -0,0 +1,54 @@
+#ifndef READPOOL_H
+#define READPOOL_H
+
+#include <QObject>
+#include <QHash>
+#include <QMutex>
+#include <QPointer>
+#include <QString>
+
+#include "database.h"
+
+class QThread;
+
+// Read-only Database connections to one ledger file, one per thread. QtSql
+// connections cannot move between threads, so every thread that calls
+// reader() gets its own, opened on first use and closed when the thread
+// finishes. Writes keep going through the application's single writer.
+//
+// With the file in WAL mode readers block neither the writer nor each
+// other, and every statement reads a committed snapshot.
+class ReadPool : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ReadPool(const QString &dbFilePath,
+                      const DatabaseOptions &options = DatabaseOptions::balanced(),
+                      QObject *parent = nullptr);
+    // Every thread that took a reader, other than the destroying one, must
+    // have finished: a QtSql connection may only be closed by the thread
+    // that opened it.
+    ~ReadPool();
+
+    // The calling thread's reader, or nullptr if it cannot be opened. Owned
+    // by the pool and only to be used on the calling thread.
+    Database *reader();
+    // Number of open readers.
+    int size() const;
+
+private:
+    struct Reader {
+        Database *db = nullptr;
+        QPointer<QThread> thread; // null once the thread object is gone
+        QMetaObject::Connection finishedHook;
+    };
+
+    void closeReader(QThread *thread);
+
+    QString path;
+    DatabaseOptions options;
+    mutable QMutex mutex;
+    QHash<QThread *, Reader> readers;
+};
+
+#endif // READPOOL_H
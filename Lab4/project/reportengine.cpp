@@ -0,0 +1,84 @@
+#include "reportengine.h"
+
+#include "readpool.h"
+
+#include <QDebug>
+#include <QMap>
+#include <QVector>
+
+#include <tuple>
+
+namespace {
+const int kSlicesPerThread = 4;
+
+using ReportKey = std::tuple<int, int, QString, int>;
+}
+
+ReportEngine::ReportEngine(ReadPool &pool, int threadCount)
+    : pool(pool)
+{
+    threads.setMaxThreadCount(qMax(threadCount, 1));
+}
+
+std::optional<QList<ReportRow>> ReportEngine::run(int dimensions, const QDateTime &from, const QDateTime &to)
+{
+    Database *reader = pool.reader();
+    if (!reader) {
+        qCritical() << "Report failed: no reader";
+        return std::nullopt;
+    }
+    const std::optional<QPair<qint64, qint64>> span = reader->transactionTimeSpan();
+    if (!span) {
+        return std::nullopt;
+    }
+    // An empty ledger's span leaves the unbounded range empty too.
+    const qint64 fromMs = from.isValid() ? from.toMSecsSinceEpoch() : span->first;
+    const qint64 toMs = to.isValid() ? to.toMSecsSinceEpoch() : span->second + 1;
+    if (fromMs >= toMs) {
+        return QList<ReportRow>();
+    }
+
+    // Slice i covers [bounds[i], bounds[i + 1]). Stepping by quotient and
+    // remainder keeps the arithmetic inside 64 bits for any range.
+    const qint64 width = toMs - fromMs;
+    const int sliceCount = int(qMin<qint64>(width, threads.maxThreadCount() * kSlicesPerThread));
+    const qint64 step = width / sliceCount;
+    const qint64 remainder = width % sliceCount;
+    QVector<qint64> bounds;
+    for (int i = 0; i < sliceCount; ++i) {
+        bounds.append(fromMs + step * i + remainder * i / sliceCount);
+    }
+    bounds.append(toMs);
+
+    // A slice left at nullopt had no reader or failed to read.
+    QVector<std::optional<QList<ReportRow>>> partials(sliceCount);
+    for (int i = 0; i < sliceCount; ++i) {
+        threads.start([this, &bounds, &partials, dimensions, i]() {
+            if (Database *db = pool.reader()) {
+                partials[i] = db->aggregateTransactions(bounds.at(i), bounds.at(i + 1), dimensions);
+            }
+        });
+    }
+    threads.waitForDone();
+
+    // A group split across slices (a month cut by a slice bound) is summed
+    // back together here.
+    QMap<ReportKey, ReportRow> merged;
+    for (const std::optional<QList<ReportRow>> &partial : partials) {
+        if (!partial) {
+            qCritical() << "Report failed: a slice could not be read";
+            return std::nullopt;
+        }
+        for (const ReportRow &row : *partial) {
+            const ReportKey key(row.categoryId, row.accountId, row.type, row.month);
+            const auto it = merged.find(key);
+            if (it == merged.end()) {
+                merged.insert(key, row);
+            } else {
+                it.value().total += row.total;
+                it.value().count += row.count;
+            }
+        }
+    }
+    return merged.values();
+}
@@ -0,0 +1,42 @@
+#ifndef REPORTENGINE_H
+#define REPORTENGINE_H
+
+#include <QDateTime>
+#include <QList>
+#include <QThread>
+#include <QThreadPool>
+#include <optional>
+
+#include "database.h"
+
+class ReadPool;
+
+// Group-by reports over the whole transaction log, in parallel. The time
+// range is cut into slices that run as separate jobs on a thread pool,
+// each aggregated by that thread's reader from pool; the partial groups
+// are then merged. There are several slices per thread so that busy
+// months do not hold up the rest.
+//
+// Sums are exact integers and the merge is keyed and ordered, so the
+// result does not depend on how the work was scheduled. Each slice reads
+// its own snapshot, so a writer committing mid-report can show up in
+// some slices and not in others.
+class ReportEngine
+{
+public:
+    explicit ReportEngine(ReadPool &pool, int threadCount = QThread::idealThreadCount());
+
+    // Groups the transactions in [from, to) by the ReportDimension flags in
+    // dimensions, ordered by (categoryId, accountId, type, month). An
+    // invalid bound means the first or last transaction. Empty for an
+    // empty range; nullopt if a slice could not be read.
+    std::optional<QList<ReportRow>> run(int dimensions = AllDimensions,
+                                        const QDateTime &from = QDateTime(),
+                                        const QDateTime &to = QDateTime());
+
+private:
+    ReadPool &pool;
+    QThreadPool threads;
+};
+
+#endif // REPORTENGINE_H
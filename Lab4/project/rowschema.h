@@ -0,0 +1,111 @@
+#ifndef ROWSCHEMA_H
+#define ROWSCHEMA_H
+
+#include <QSqlQuery>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+
+#include "database.h"
+
+// Column layout of each entity as stored in SQLite. The select list and the
+// decoder are generated from the same description, so decoders can read by
+// position instead of looking every field up by name on every row.
+template <typename Row>
+struct RowSchema;
+
+template <>
+struct RowSchema<Transaction> {
+    enum Column { Id, Amount, Type, CategoryId, AccountId, Time, Note, ColumnCount };
+    static constexpr const char *columns[ColumnCount] = {
+        "id", "amount", "type", "categoryId", "accountId", "time", "note",
+    };
+
+    static void decode(const QSqlQuery &query, Transaction &tx)
+    {
+        tx.id = query.value(Id).toInt();
+        tx.amount = Money::fromMinor(query.value(Amount).toLongLong());
+        tx.type = query.value(Type).toString();
+        tx.categoryId = query.value(CategoryId).toInt();
+        tx.accountId = query.value(AccountId).toInt();
+        tx.time = QDateTime::fromMSecsSinceEpoch(query.value(Time).toLongLong());
+        tx.note = query.value(Note).toString();
+    }
+};
+
+template <>
+struct RowSchema<Account> {
+    enum Column { Id, Name, Type, Balance, ColumnCount };
+    static constexpr const char *columns[ColumnCount] = {
+        "id", "name", "type", "balance",
+    };
+
+    static void decode(const QSqlQuery &query, Account &acc)
+    {
+        acc.id = query.value(Id).toInt();
+        acc.name = query.value(Name).toString();
+        acc.type = query.value(Type).toString();
+        acc.balance = Money::fromMinor(query.value(Balance).toLongLong());
+    }
+};
+
+template <>
+struct RowSchema<Category> {
+    enum Column { Id, Name, Type, ColumnCount };
+    static constexpr const char *columns[ColumnCount] = {
+        "id", "name", "type",
+    };
+
+    static void decode(const QSqlQuery &query, Category &cat)
+    {
+        cat.id = query.value(Id).toInt();
+        cat.name = query.value(Name).toString();
+        cat.type = query.value(Type).toString();
+    }
+};
+
+template <>
+struct RowSchema<Budget> {
+    enum Column { Id, CategoryId, Month, Limit, ColumnCount };
+    static constexpr const char *columns[ColumnCount] = {
+        "id", "categoryId", "month", "limit_amount",
+    };
+
+    static void decode(const QSqlQuery &query, Budget &budget)
+    {
+        budget.id = query.value(Id).toInt();
+        budget.categoryId = query.value(CategoryId).toInt();
+        budget.month = query.value(Month).toInt();
+        budget.limit = Money::fromMinor(query.value(Limit).toLongLong());
+    }
+};
+
+// "id, amount, ..." in schema order, built once per row type.
+template <typename Row>
+const QString &selectList()
+{
+    static const QString list = [] {
+        QStringList names;
+        for (const char *name : RowSchema<Row>::columns) {
+            names << QString::fromLatin1(name);
+        }
+        return names.join(QStringLiteral(", "));
+    }();
+    return list;
+}
+
+template <typename Row>
+QString selectFrom(const char *table)
+{
+    return QStringLiteral("SELECT ") + selectList<Row>() + QStringLiteral(" FROM ") + QString::fromLatin1(table);
+}
+
+template <typename Row>
+Row decodeRow(const QSqlQuery &query)
+{
+    Row row;
+    RowSchema<Row>::decode(query, row);
+    return row;
+}
+
+#endif // ROWSCHEMA_H
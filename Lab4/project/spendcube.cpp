@@ -0,0 +1,215 @@
+#include "spendcube.h"
+
+#include "columnstore.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QFile>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <tuple>
+
+namespace {
+
+// A cell key packs 20-bit dictionary indexes of category, account and
+// month, and the 2-bit type code.
+const int kIndexBits = 20;
+const quint64 kIndexMask = (quint64(1) << kIndexBits) - 1;
+const int kMonthShift = 2;
+const int kAccountShift = kMonthShift + kIndexBits;
+const int kCategoryShift = kAccountShift + kIndexBits;
+const quint64 kTypeMask = 0x3;
+
+const quint32 kFileMagic = 0x4C435542; // "LCUB"
+const quint32 kFileVersion = 2;
+
+const char *const kTypeNames[] = {"Income", "Expense", "Transfer", ""};
+
+quint64 packKey(int category, int account, int month, int type)
+{
+    return (quint64(category) << kCategoryShift) | (quint64(account) << kAccountShift)
+            | (quint64(month) << kMonthShift) | quint64(type);
+}
+
+} // namespace
+
+void SpendCube::clear()
+{
+    cells.clear();
+    writeGeneration = -1;
+    categories.clear();
+    accounts.clear();
+    months.clear();
+    categoryIndex.clear();
+    accountIndex.clear();
+    monthIndex.clear();
+}
+
+void SpendCube::add(int categoryId, int accountId, const QString &type, int month, Money total, qint64 count)
+{
+    const quint64 key = packKey(encode(categoryId, categories, categoryIndex),
+                                encode(accountId, accounts, accountIndex),
+                                encode(month, months, monthIndex),
+                                ColumnStore::typeCode(type));
+    Cell &cell = cells[key];
+    cell.total += total.minor();
+    cell.count += count;
+    if (cell.count == 0) {
+        cells.remove(key);
+    }
+}
+
+void SpendCube::followWrite(qint64 before)
+{
+    writeGeneration = writeGeneration == before ? before + 1 : -1;
+}
+
+QList<ReportRow> SpendCube::rollUp(int dimensions, const CubeSlice &slice) const
+{
+    const QVector<bool> categoryOk = matching(categories, slice.categoryIds);
+    const QVector<bool> accountOk = matching(accounts, slice.accountIds);
+    QVector<bool> monthOk(months.size(), true);
+    for (int i = 0; i < months.size(); ++i) {
+        monthOk[i] = (slice.fromMonth == 0 || months.at(i) >= slice.fromMonth)
+                && (slice.toMonth == 0 || months.at(i) <= slice.toMonth);
+    }
+    bool typeOk[4] = {true, true, true, true};
+    if (!slice.types.isEmpty()) {
+        for (int t = 0; t < 4; ++t) {
+            typeOk[t] = slice.types.contains(QString::fromLatin1(kTypeNames[t]));
+        }
+    }
+
+    // Dimensions rolled up are zeroed out of the key, which merges their
+    // cells into one group.
+    quint64 keep = 0;
+    if (dimensions & ByCategory) keep |= kIndexMask << kCategoryShift;
+    if (dimensions & ByAccount) keep |= kIndexMask << kAccountShift;
+    if (dimensions & ByMonth) keep |= kIndexMask << kMonthShift;
+    if (dimensions & ByType) keep |= kTypeMask;
+
+    QHash<quint64, Cell> groups;
+    for (auto it = cells.constBegin(); it != cells.constEnd(); ++it) {
+        const quint64 key = it.key();
+        if (!categoryOk.at(int((key >> kCategoryShift) & kIndexMask))
+                || !accountOk.at(int((key >> kAccountShift) & kIndexMask))
+                || !monthOk.at(int((key >> kMonthShift) & kIndexMask))
+                || !typeOk[key & kTypeMask]) {
+            continue;
+        }
+        Cell &group = groups[key & keep];
+        group.total += it.value().total;
+        group.count += it.value().count;
+    }
+
+    QList<ReportRow> rows;
+    rows.reserve(groups.size());
+    for (auto it = groups.constBegin(); it != groups.constEnd(); ++it) {
+        const quint64 key = it.key();
+        ReportRow row;
+        row.categoryId = (dimensions & ByCategory) ? categories.at(int((key >> kCategoryShift) & kIndexMask)) : 0;
+        row.accountId = (dimensions & ByAccount) ? accounts.at(int((key >> kAccountShift) & kIndexMask)) : 0;
+        row.type = (dimensions & ByType) ? QString::fromLatin1(kTypeNames[key & kTypeMask]) : QString();
+        row.month = (dimensions & ByMonth) ? months.at(int((key >> kMonthShift) & kIndexMask)) : 0;
+        row.total = Money::fromMinor(it.value().total);
+        row.count = it.value().count;
+        rows.append(row);
+    }
+    std::sort(rows.begin(), rows.end(), [](const ReportRow &a, const ReportRow &b) {
+        return std::tie(a.categoryId, a.accountId, a.type, a.month)
+                < std::tie(b.categoryId, b.accountId, b.type, b.month);
+    });
+    return rows;
+}
+
+bool SpendCube::save(const QString &path) const
+{
+    // QSaveFile only replaces the old file once the new one is complete.
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCritical() << "Failed to write spend cube" << path << ":" << file.errorString();
+        return false;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_15);
+    out << kFileMagic << kFileVersion << writeGeneration << quint32(cells.size());
+    for (auto it = cells.constBegin(); it != cells.constEnd(); ++it) {
+        const quint64 key = it.key();
+        out << qint32(categories.at(int((key >> kCategoryShift) & kIndexMask)))
+            << qint32(accounts.at(int((key >> kAccountShift) & kIndexMask)))
+            << qint32(months.at(int((key >> kMonthShift) & kIndexMask)))
+            << quint8(key & kTypeMask)
+            << it.value().total
+            << it.value().count;
+    }
+    if (out.status() != QDataStream::Ok || !file.commit()) {
+        qCritical() << "Failed to write spend cube" << path << ":" << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool SpendCube::load(const QString &path)
+{
+    clear();
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to read spend cube" << path << ":" << file.errorString();
+        return false;
+    }
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_15);
+    quint32 magic = 0;
+    quint32 version = 0;
+    in >> magic >> version;
+    if (in.status() != QDataStream::Ok || magic != kFileMagic || version != kFileVersion) {
+        qWarning() << "Spend cube" << path << "is not a version" << kFileVersion << "cube file";
+        return false;
+    }
+    qint64 generation = -1;
+    quint32 cellTotal = 0;
+    in >> generation >> cellTotal;
+    if (in.status() != QDataStream::Ok) {
+        qWarning() << "Spend cube" << path << "is truncated or corrupt";
+        return false;
+    }
+    for (quint32 i = 0; i < cellTotal; ++i) {
+        qint32 categoryId = 0;
+        qint32 accountId = 0;
+        qint32 month = 0;
+        quint8 type = 0;
+        qint64 total = 0;
+        qint64 count = 0;
+        in >> categoryId >> accountId >> month >> type >> total >> count;
+        if (in.status() != QDataStream::Ok || type > kTypeMask) {
+            qWarning() << "Spend cube" << path << "is truncated or corrupt";
+            clear();
+            return false;
+        }
+        add(categoryId, accountId, QString::fromLatin1(kTypeNames[type]), month, Money::fromMinor(total), count);
+    }
+    writeGeneration = generation;
+    return true;
+}
+
+int SpendCube::encode(int value, QVector<int> &values, QHash<int, int> &index)
+{
+    const auto it = index.constFind(value);
+    if (it != index.constEnd()) {
+        return it.value();
+    }
+    const int encoded = values.size();
+    values.append(value);
+    index.insert(value, encoded);
+    return encoded;
+}
+
+QVector<bool> SpendCube::matching(const QVector<int> &values, const QList<int> &wanted)
+{
+    QVector<bool> ok(values.size(), wanted.isEmpty());
+    for (int i = 0; !wanted.isEmpty() && i < values.size(); ++i) {
+        ok[i] = wanted.contains(values.at(i));
+    }
+    return ok;
+}
@@ -0,0 +1,78 @@
+#ifndef SPENDCUBE_H
+#define SPENDCUBE_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QtGlobal>
+
+#include "database.h"
+
+// Restricts SpendCube::rollUp() to some values per dimension; an empty
+// list, or a zero month bound, leaves that dimension unrestricted.
+struct CubeSlice {
+    QList<int> categoryIds;
+    QList<int> accountIds;
+    QStringList types;
+    int fromMonth = 0; // YYYYMM, inclusive
+    int toMonth = 0;   // YYYYMM, inclusive
+};
+
+// Sums and counts of transactions pre-aggregated over category x account
+// x month x type, held in memory. Only non-empty cells are stored, keyed
+// on dictionary-encoded dimension values, so any slice or roll-up is a
+// walk over the cells rather than over the transactions.
+//
+// Filled by Database::loadSpendCube() and kept current by that
+// Database's mutation methods once their writes commit.
+class SpendCube
+{
+public:
+    void clear();
+    // Adds count rows totalling total to one cell; negative values take
+    // rows out. A cell left with no rows is dropped.
+    void add(int categoryId, int accountId, const QString &type, int month, Money total, qint64 count);
+
+    int cellCount() const { return cells.size(); }
+
+    // The Database::writeGeneration() the cells reflect, or -1 if unknown.
+    qint64 generation() const { return writeGeneration; }
+    void setGeneration(qint64 generation) { writeGeneration = generation; }
+    // Follows a write that moved the ledger on from generation before. A
+    // cube that was not at before has missed another connection's write.
+    void followWrite(qint64 before);
+
+    // The cells matching slice, summed over the dimensions not listed in
+    // the ReportDimension flags of dimensions, ordered like ReportEngine's
+    // rows. rollUp(0) is the grand total of the slice.
+    QList<ReportRow> rollUp(int dimensions, const CubeSlice &slice = CubeSlice()) const;
+
+    // A versioned binary dump of the generation and the cells. load()
+    // replaces the cube and leaves it empty if the file is unreadable or
+    // of another version.
+    bool save(const QString &path) const;
+    bool load(const QString &path);
+
+private:
+    struct Cell {
+        qint64 total = 0;
+        qint64 count = 0;
+    };
+
+    static int encode(int value, QVector<int> &values, QHash<int, int> &index);
+    static QVector<bool> matching(const QVector<int> &values, const QList<int> &wanted);
+
+    QHash<quint64, Cell> cells;
+    qint64 writeGeneration = -1;
+    // Dimension values by dense index and back; indexes are never reused.
+    QVector<int> categories;
+    QVector<int> accounts;
+    QVector<int> months;
+    QHash<int, int> categoryIndex;
+    QHash<int, int> accountIndex;
+    QHash<int, int> monthIndex;
+};
+
+#endif // SPENDCUBE_H
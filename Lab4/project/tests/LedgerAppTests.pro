@@ -7,10 +7,28 @@ TARGET = LedgerAppTests
 
 SOURCES += \
     tst_database.cpp \
-    ../database.cpp
+    ../database.cpp \
+    ../columnstore.cpp \
+    ../aggregatekernels.cpp \
+    ../asyncdatabase.cpp \
+    ../readpool.cpp \
+    ../writequeue.cpp \
+    ../balanceverifier.cpp \
+    ../reportengine.cpp \
+    ../spendcube.cpp
 
 HEADERS += \
-    ../database.h
+    ../database.h \
+    ../columnstore.h \
+    ../aggregatekernels.h \
+    ../asyncdatabase.h \
+    ../readpool.h \
+    ../writequeue.h \
+    ../balanceverifier.h \
+    ../reportengine.h \
+    ../spendcube.h \
+    ../money.h \
+    ../rowschema.h
 
 # Make it easy to turn on coverage from CI: qmake "CONFIG+=coverage"
 coverage {
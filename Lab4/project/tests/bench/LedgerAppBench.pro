@@ -0,0 +1,29 @@
+QT += core testlib sql
+CONFIG += console c++17
+CONFIG -= app_bundle
+
+TEMPLATE = app
+TARGET = LedgerAppBench
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    bench_database.cpp \
+    ../../database.cpp \
+    ../../columnstore.cpp \
+    ../../aggregatekernels.cpp \
+    ../../readpool.cpp \
+    ../../balanceverifier.cpp \
+    ../../reportengine.cpp \
+    ../../spendcube.cpp
+
+HEADERS += \
+    ../../database.h \
+    ../../columnstore.h \
+    ../../aggregatekernels.h \
+    ../../readpool.h \
+    ../../balanceverifier.h \
+    ../../reportengine.h \
+    ../../spendcube.h \
+    ../../money.h \
+    ../../rowschema.h
@@ -0,0 +1,525 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+
+#include <iterator>
+
+#include "aggregatekernels.h"
+#include "balanceverifier.h"
+#include "columnstore.h"
+#include "database.h"
+#include "readpool.h"
+#include "reportengine.h"
+#include "rowschema.h"
+#include "spendcube.h"
+
+// Read-path benchmarks over a generated ledger. Sizes come from
+// LEDGER_BENCH_ROWS (transactions, default 1000000) and
+// LEDGER_BENCH_CATEGORIES (expense categories, default 1000) and
+// LEDGER_BENCH_ACCOUNTS (default 64).
+// Run with e.g. `LEDGER_BENCH_ROWS=50000 ./LedgerAppBench -iterations 5`.
+class DatabaseBench : public QObject {
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void decode_byName();
+    void decode_byIndex();
+    void findTransactions_all();
+    void budgetReport_perCategoryLoop();
+    void budgetReport_singleQuery();
+    void noteSearch_likeScan();
+    void noteSearch_ftsIndex();
+    void balances_verifySerial();
+    void balances_verifyParallel();
+    void byCategory_sqlGroupBy();
+    void byCategory_columnStore();
+    void monthlyReport_calculateSpentLoop();
+    void monthlyReport_kernelScalar();
+    void monthlyReport_kernelBest();
+    void report_oneThread();
+    void report_threadPool();
+    void report_spendCube();
+
+private:
+    void report(const char *label, qint64 nsecs, int rows) const;
+    void monthlyReportKernel(AggregateKernels::Isa isa);
+    void groupByReport(int threadCount, const char *label);
+
+    QTemporaryDir tempDir;
+    QString dbPath;
+    int rowCount = 1000000;
+    int categoryCount = 1000;
+    int accountCount = 64;
+    int reportMonth = 202401;
+};
+
+namespace {
+
+// The decoder as it was before RowSchema: every field looked up by name.
+void decodeByName(const QSqlQuery &query, Transaction &tx)
+{
+    tx.id = query.value("id").toInt();
+    tx.amount = Money::fromMinor(query.value("amount").toLongLong());
+    tx.type = query.value("type").toString();
+    tx.categoryId = query.value("categoryId").toInt();
+    tx.accountId = query.value("accountId").toInt();
+    tx.time = QDateTime::fromMSecsSinceEpoch(query.value("time").toLongLong());
+    tx.note = query.value("note").toString();
+}
+
+const char *kConnection = "bench_raw";
+
+// Notes cycle through a few payees; one row in a thousand is a refund,
+// which is what the note search benchmarks look for.
+const char *const kPayees[] = {"Groceries", "Rent", "Coffee", "Fuel", "Pharmacy", "Books", "Transit"};
+const int kRefundEvery = 1000;
+
+int envInt(const char *name, int fallback)
+{
+    bool ok = false;
+    const int value = qEnvironmentVariableIntValue(name, &ok);
+    return ok && value > 0 ? value : fallback;
+}
+
+} // namespace
+
+void DatabaseBench::initTestCase()
+{
+    rowCount = envInt("LEDGER_BENCH_ROWS", rowCount);
+    categoryCount = envInt("LEDGER_BENCH_CATEGORIES", categoryCount);
+    accountCount = envInt("LEDGER_BENCH_ACCOUNTS", accountCount);
+
+    QVERIFY(tempDir.isValid());
+    dbPath = tempDir.filePath("bench.db");
+
+    Database db;
+    QVERIFY(db.init(dbPath, DatabaseOptions::bulk()));
+
+    QList<int> accountIds;
+    for (int a = 0; a < accountCount; ++a) {
+        Account acc;
+        acc.name = QStringLiteral("Bench %1").arg(a);
+        acc.type = "Cash";
+        acc.balance = Money();
+        QVERIFY(db.addAccount(acc));
+        accountIds.append(acc.id);
+    }
+
+    // Every other category has a budget for the report month.
+    QList<int> categoryIds;
+    for (int c = 0; c < categoryCount; ++c) {
+        Category cat;
+        cat.name = QStringLiteral("Category %1").arg(c);
+        cat.type = "Expense";
+        QVERIFY(db.addCategory(cat));
+        categoryIds.append(cat.id);
+        if (c % 2 == 0) {
+            Budget budget;
+            budget.id = -1;
+            budget.categoryId = cat.id;
+            budget.month = reportMonth;
+            budget.limit = Money::fromMinor(50000);
+            QVERIFY(db.setBudget(budget));
+        }
+    }
+
+    // One row a minute from the start of the report month, spread over all
+    // categories; inserted in chunks to bound memory.
+    const QDateTime start(QDate(reportMonth / 100, reportMonth % 100, 1), QTime(0, 0));
+    const int chunk = 10000;
+    QList<Transaction> batch;
+    batch.reserve(chunk);
+    for (int i = 0; i < rowCount; ++i) {
+        Transaction tx;
+        tx.amount = Money::fromMinor(100 + (i % 100) * 100);
+        tx.type = "Expense";
+        tx.categoryId = categoryIds.at(i % categoryIds.size());
+        tx.accountId = accountIds.at(i % accountIds.size());
+        tx.time = start.addSecs(qint64(i) * 60);
+        tx.note = QStringLiteral("%1 row %2").arg(QString::fromLatin1(kPayees[i % int(std::size(kPayees))])).arg(i);
+        if (i % kRefundEvery == 0) {
+            tx.note += QStringLiteral(" refund");
+        }
+        batch.append(tx);
+        if (batch.size() == chunk || i == rowCount - 1) {
+            QVERIFY(db.addTransactions(batch));
+            batch.clear();
+        }
+    }
+
+    QSqlDatabase raw = QSqlDatabase::addDatabase("QSQLITE", kConnection);
+    raw.setDatabaseName(dbPath);
+    QVERIFY(raw.open());
+}
+
+void DatabaseBench::cleanupTestCase()
+{
+    QSqlDatabase::database(kConnection).close();
+    QSqlDatabase::removeDatabase(kConnection);
+}
+
+void DatabaseBench::report(const char *label, qint64 nsecs, int rows) const
+{
+    if (rows > 0) {
+        qInfo("%s: %.1f ns/row over %d rows", label, double(nsecs) / rows, rows);
+    }
+}
+
+void DatabaseBench::decode_byName()
+{
+    QSqlQuery query(QSqlDatabase::database(kConnection));
+    query.setForwardOnly(true);
+    QVERIFY(query.prepare(selectFrom<Transaction>("transactions")));
+
+    qint64 nsecs = 0;
+    int rows = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        QVERIFY(query.exec());
+        rows = 0;
+        Transaction tx;
+        while (query.next()) {
+            decodeByName(query, tx);
+            ++rows;
+        }
+        query.finish();
+        nsecs = timer.nsecsElapsed();
+    }
+    QCOMPARE(rows, rowCount);
+    report("decode by name", nsecs, rows);
+}
+
+void DatabaseBench::decode_byIndex()
+{
+    QSqlQuery query(QSqlDatabase::database(kConnection));
+    query.setForwardOnly(true);
+    QVERIFY(query.prepare(selectFrom<Transaction>("transactions")));
+
+    qint64 nsecs = 0;
+    int rows = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        QVERIFY(query.exec());
+        rows = 0;
+        Transaction tx;
+        while (query.next()) {
+            RowSchema<Transaction>::decode(query, tx);
+            ++rows;
+        }
+        query.finish();
+        nsecs = timer.nsecsElapsed();
+    }
+    QCOMPARE(rows, rowCount);
+    report("decode by index", nsecs, rows);
+}
+
+void DatabaseBench::findTransactions_all()
+{
+    Database db;
+    QVERIFY(db.init(dbPath));
+
+    qint64 nsecs = 0;
+    int rows = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        rows = db.findTransactions(TransactionQuery()).size();
+        nsecs = timer.nsecsElapsed();
+    }
+    QCOMPARE(rows, rowCount);
+    report("findTransactions", nsecs, rows);
+}
+
+// The shape refreshBudgetView had: 2N+1 statements for N categories.
+void DatabaseBench::budgetReport_perCategoryLoop()
+{
+    Database db;
+    QVERIFY(db.init(dbPath));
+
+    qint64 nsecs = 0;
+    int rows = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        const QList<Category> categories = db.getAllCategories("Expense");
+        for (const Category &cat : categories) {
+            db.getBudget(cat.id, reportMonth);
+            db.calculateSpent(cat.id, reportMonth);
+        }
+        rows = categories.size();
+        nsecs = timer.nsecsElapsed();
+    }
+    QCOMPARE(rows, categoryCount);
+    report("budget report, per-category loop", nsecs, rows);
+}
+
+void DatabaseBench::budgetReport_singleQuery()
+{
+    Database db;
+    QVERIFY(db.init(dbPath));
+
+    qint64 nsecs = 0;
+    int rows = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        rows = db.getBudgetReport(reportMonth).size();
+        nsecs = timer.nsecsElapsed();
+    }
+    QCOMPARE(rows, categoryCount);
+    report("budget report, single query", nsecs, rows);
+}
+
+// What searching notes meant before the index: a LIKE over every row.
+void DatabaseBench::noteSearch_likeScan()
+{
+    Database db;
+    QVERIFY(db.init(dbPath));
+    TransactionQuery query;
+    query.noteContains = QStringLiteral("refund");
+
+    qint64 nsecs = 0;
+    int rows = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        rows = db.findTransactions(query).size();
+        nsecs = timer.nsecsElapsed();
+    }
+    QCOMPARE(rows, (rowCount + kRefundEvery - 1) / kRefundEvery);
+    report("note search, LIKE scan", nsecs, rows);
+}
+
+void DatabaseBench::noteSearch_ftsIndex()
+{
+    Database db;
+    QVERIFY(db.init(dbPath));
+    if (!db.hasNoteIndex()) {
+        QSKIP("SQLite was built without FTS5");
+    }
+
+    qint64 nsecs = 0;
+    int rows = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        rows = db.searchNotes(QStringLiteral("refund"), rowCount).size();
+        nsecs = timer.nsecsElapsed();
+    }
+    QCOMPARE(rows, (rowCount + kRefundEvery - 1) / kRefundEvery);
+    report("note search, FTS5 index", nsecs, rows);
+}
+
+void DatabaseBench::balances_verifySerial()
+{
+    Database db;
+    QVERIFY(db.init(dbPath));
+
+    qint64 nsecs = 0;
+    int drifted = -1;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        const std::optional<QList<BalanceDrift>> drift = db.verifyBalances();
+        drifted = drift ? drift->size() : -1;
+        nsecs = timer.nsecsElapsed();
+    }
+    QCOMPARE(drifted, 0);
+    report("balance verification, one connection", nsecs, rowCount);
+}
+
+void DatabaseBench::balances_verifyParallel()
+{
+    ReadPool pool(dbPath);
+    BalanceVerifier verifier(pool);
+
+    qint64 nsecs = 0;
+    int drifted = -1;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        const std::optional<QList<BalanceDrift>> drift = verifier.verify();
+        drifted = drift ? drift->size() : -1;
+        nsecs = timer.nsecsElapsed();
+    }
+    QCOMPARE(drifted, 0);
+    report("balance verification, thread pool", nsecs, rowCount);
+}
+
+void DatabaseBench::byCategory_sqlGroupBy()
+{
+    QSqlQuery query(QSqlDatabase::database(kConnection));
+    query.setForwardOnly(true);
+    QVERIFY(query.prepare("SELECT categoryId, SUM(amount), COUNT(*) FROM transactions "
+                          "WHERE type = 'Expense' GROUP BY categoryId"));
+
+    qint64 nsecs = 0;
+    int groups = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        QVERIFY(query.exec());
+        groups = 0;
+        while (query.next()) {
+            ++groups;
+        }
+        query.finish();
+        nsecs = timer.nsecsElapsed();
+    }
+    QCOMPARE(groups, categoryCount);
+    report("spend by category, SQL GROUP BY", nsecs, rowCount);
+}
+
+void DatabaseBench::byCategory_columnStore()
+{
+    Database db;
+    QVERIFY(db.init(dbPath));
+    QElapsedTimer loadTimer;
+    loadTimer.start();
+    QVERIFY(db.loadColumnStore());
+    report("column store load", loadTimer.nsecsElapsed(), rowCount);
+    const ColumnStore *store = db.columnStore();
+
+    qint64 nsecs = 0;
+    int groups = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        groups = store->totalsByCategory(ColumnStore::Expense, std::numeric_limits<qint64>::min(),
+                                         std::numeric_limits<qint64>::max()).size();
+        nsecs = timer.nsecsElapsed();
+    }
+    QCOMPARE(groups, categoryCount);
+    report("spend by category, column store", nsecs, rowCount);
+}
+
+// A year of spend per category and month the way the budget view gets it:
+// one calculateSpent call per cell.
+void DatabaseBench::monthlyReport_calculateSpentLoop()
+{
+    Database db;
+    QVERIFY(db.init(dbPath));
+    const QList<Category> categories = db.getAllCategories("Expense");
+    const int year = reportMonth / 100;
+
+    qint64 nsecs = 0;
+    Money total;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        total = Money();
+        for (const Category &cat : categories) {
+            for (int month = 1; month <= 12; ++month) {
+                total += db.calculateSpent(cat.id, year * 100 + month);
+            }
+        }
+        nsecs = timer.nsecsElapsed();
+    }
+    QVERIFY(total > Money());
+    report("monthly report, calculateSpent per cell", nsecs, categories.size() * 12);
+}
+
+void DatabaseBench::monthlyReport_kernelScalar()
+{
+    monthlyReportKernel(AggregateKernels::Isa::Scalar);
+}
+
+void DatabaseBench::monthlyReport_kernelBest()
+{
+    monthlyReportKernel(AggregateKernels::bestIsa());
+}
+
+void DatabaseBench::monthlyReportKernel(AggregateKernels::Isa isa)
+{
+    Database db;
+    QVERIFY(db.init(dbPath));
+    QVERIFY(db.loadColumnStore());
+    const ColumnStore *store = db.columnStore();
+    const int year = reportMonth / 100;
+
+    qint64 nsecs = 0;
+    int categories = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        categories = store->monthlyTotalsByCategory(ColumnStore::Expense, year, isa).size();
+        nsecs = timer.nsecsElapsed();
+    }
+    QVERIFY(categories > 0);
+    const QByteArray label = QByteArray("monthly report, one pass, ") + AggregateKernels::isaName(isa);
+    report(label.constData(), nsecs, categories * 12);
+}
+
+void DatabaseBench::report_oneThread()
+{
+    groupByReport(1, "category x account x type x month report, one thread");
+}
+
+void DatabaseBench::report_threadPool()
+{
+    groupByReport(QThread::idealThreadCount(), "category x account x type x month report, thread pool");
+}
+
+void DatabaseBench::groupByReport(int threadCount, const char *label)
+{
+    ReadPool pool(dbPath);
+    ReportEngine engine(pool, threadCount);
+
+    qint64 nsecs = 0;
+    qint64 rows = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        rows = 0;
+        const std::optional<QList<ReportRow>> report = engine.run();
+        QVERIFY(report);
+        for (const ReportRow &row : *report) {
+            rows += row.count;
+        }
+        nsecs = timer.nsecsElapsed();
+    }
+    QCOMPARE(rows, qint64(rowCount));
+    report(label, nsecs, rowCount);
+}
+
+// The same report answered from the pre-aggregated cube, after loading it
+// once from SQL and once from its saved file.
+void DatabaseBench::report_spendCube()
+{
+    const QString cachePath = tempDir.filePath("bench.cube");
+    Database db;
+    QVERIFY(db.init(dbPath));
+    QElapsedTimer loadTimer;
+    loadTimer.start();
+    QVERIFY(db.loadSpendCube(cachePath));
+    report("spend cube build", loadTimer.nsecsElapsed(), rowCount);
+    loadTimer.restart();
+    QVERIFY(db.loadSpendCube(cachePath));
+    report("spend cube load from file", loadTimer.nsecsElapsed(), rowCount);
+    const SpendCube *cube = db.spendCube();
+
+    qint64 nsecs = 0;
+    qint64 rows = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        rows = 0;
+        for (const ReportRow &row : cube->rollUp(AllDimensions)) {
+            rows += row.count;
+        }
+        nsecs = timer.nsecsElapsed();
+    }
+    QCOMPARE(rows, qint64(rowCount));
+    report("category x account x type x month report, spend cube", nsecs, rowCount);
+}
+
+QTEST_MAIN(DatabaseBench)
+#include "bench_database.moc"
@@ -3,8 +3,21 @@
 #include <QDir>
 #include <QDateTime>
 #include <QFileInfo>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QRandomGenerator>
+#include <QSemaphore>
+#include <QThread>
 
 #include "../database.h"
+#include "../columnstore.h"
+#include "../aggregatekernels.h"
+#include "../asyncdatabase.h"
+#include "../readpool.h"
+#include "../writequeue.h"
+#include "../balanceverifier.h"
+#include "../reportengine.h"
+#include "../spendcube.h"
 
 class DatabaseTests : public QObject {
     Q_OBJECT
@@ -13,6 +26,12 @@ private slots:
     // -------- Setup / init edge cases --------
     void db_init_default_usesCwdLedgerDb();
     void db_init_invalidPath_fails();
+    void db_init_freshDatabase_reachesLatestSchema();
+    void db_init_legacyDatabase_migratedInPlace();
+    void db_init_defaultOptions_keepRollbackJournal();
+    void db_init_balancedProfile_enablesWal();
+    void db_init_defaultOptions_leaveWalFileInWal();
+    void db_init_bulkProfile_appliesCacheAndTempStore();
 
     // -------- Unit tests: Accounts / Balance (>=10) --------
     void account_addAccount_setsId();
@@ -24,6 +43,8 @@ private slots:
     void account_updateBalance_decreases();
     void account_updateBalance_nonexistentId_fails();
     void account_updateBalance_withoutInit_fails();
+    void account_updateBalance_manyCentDeltas_noDrift();
+    void money_fromDouble_roundsAndFormats();
     void account_balance_matchesAfterTransaction_income();
     void account_balance_matchesAfterTransaction_expense();
     void account_deleteTransaction_revertsBalance();
@@ -39,13 +60,53 @@ private slots:
     void tx_addTransaction_unknownType_failsAndNoInsert();
     void tx_addTransaction_badAccount_rollsBackInsert();
     void tx_updateTransaction_adjustsBalance();
+    void tx_addTransactions_batch_setsIdsAndBalances();
+    void tx_addTransactions_badAccount_rollsBackWholeBatch();
     void tx_calculateSpent_empty_returns0();
     void tx_calculateSpent_onlyExpenseAndMonthCounted();
+    void tx_monthBucket_utcInputUsesLocalMonth();
+    void tx_time_roundTripsWithMilliseconds();
     void category_addCategory_duplicate_fails();
     void category_getAllCategories_filterType_returnsOnlyMatches();
     void budget_setAndGetBudget_roundTrip();
     void budget_getBudget_missing_returnsSentinel();
+    void budget_getBudgetReport_matchesPerCategoryCalls();
     void tx_findTransactions_sortedByTimeDesc();
+    void txQuery_typeAndAccount_matchesOnlyThose();
+    void txQuery_timeRangeOrderAndLimit();
+    void txQuery_noteContains_treatsWildcardsLiterally();
+    void txQuery_sameShape_reusesStatement();
+    void page_forwardAndBackward_walkAllRows();
+    void page_concurrentInsert_doesNotShiftNextPage();
+    void page_countTransactions_matchesFilter();
+    void stream_forEachTransaction_visitsInQueryOrder();
+    void stream_forEachTransaction_stopsEarly();
+    void stmtCache_repeatedCalls_reusePreparedStatement();
+    void stmtCache_reopen_invalidatesStatements();
+    void stmtCache_manyShapes_evictLeastRecentlyUsed();
+    void stmtCache_archiveFold_keepsUnrelatedStatements();
+    void rollup_writes_keepRollupConsistent();
+    void rollup_verify_reportsDriftAndRebuildRepairs();
+    void cache_categoryName_warmLookupsRunNoStatements();
+    void cache_accountWrites_areWrittenThrough();
+    void cache_rolledBackBatch_doesNotLeakBalances();
+    void async_operations_runInOrderOnWorkerThread();
+    void async_cancel_skipsQueuedOperation();
+    void async_backup_writesProceedDuringCopy();
+    void readPool_readersArePerThreadAndReadOnly();
+    void readPool_snapshot_isStableWhileWriterCommits();
+    void writeQueue_groupCommit_keepsPerItemAtomicity();
+    void writeQueue_maxDelay_flushesPartialBatch();
+    void notes_search_matchesPrefixesAndFollowsWrites();
+    void balances_verify_findsDriftAcrossRangesAndRepairFixesIt();
+    void balances_asOf_checkpointsFollowBackdatedWrites();
+    void archive_year_movesRowsAndQueriesFanOut();
+    void archive_manyYears_foldsOldFilesAndReadsAll();
+    void backup_whileWriting_copiesConsistentSnapshot();
+    void columns_aggregates_matchSqlAndFollowWrites();
+    void kernels_everyIsa_matchesScalarAndRollup();
+    void report_parallel_matchesSerialAndRollup();
+    void cube_rollUps_followWritesAndPersist();
 
     // -------- Integration tests (>=2 groups) --------
     void it_endToEnd_budgetVsSpent();
@@ -69,7 +130,7 @@ private:
         acc.id = -1;
         acc.name = name;
         acc.type = type;
-        acc.balance = balance;
+        acc.balance = Money::fromDouble(balance);
         return acc;
     }
 
@@ -89,7 +150,7 @@ private:
                               const QString &note = QString()) {
         Transaction tx;
         tx.id = -1;
-        tx.amount = amount;
+        tx.amount = Money::fromDouble(amount);
         tx.type = type;
         tx.categoryId = categoryId;
         tx.accountId = accountId;
@@ -97,6 +158,56 @@ private:
         tx.note = note;
         return tx;
     }
+
+    // Number of drifted accounts, or -1 if the check could not run.
+    static int driftCount(const std::optional<QList<BalanceDrift>> &drift) {
+        return drift ? drift->size() : -1;
+    }
+
+    // What seedReportLedger() wrote.
+    struct ReportLedger {
+        QList<int> accountIds;  // A, B
+        QList<int> categoryIds; // Food, Fuel (Expense)
+        int salaryId = -1;      // Salary (Income)
+        QList<Transaction> batch;
+    };
+
+    // Two accounts, two expense categories and an income one, then
+    // rowCount rows 29 hours apart from start: every fifth one income, the
+    // rest alternating between the accounts and the expense categories.
+    static bool seedReportLedger(Database &db, const QDateTime &start, int rowCount, ReportLedger &ledger) {
+        for (const char *name : {"A", "B"}) {
+            Account acc = makeAccount(name, "Cash", 0.0);
+            if (!db.addAccount(acc)) return false;
+            ledger.accountIds << acc.id;
+        }
+        for (const char *name : {"Food", "Fuel"}) {
+            Category cat = makeCategory(name, "Expense");
+            if (!db.addCategory(cat)) return false;
+            ledger.categoryIds << cat.id;
+        }
+        Category salary = makeCategory("Salary", "Income");
+        if (!db.addCategory(salary)) return false;
+        ledger.salaryId = salary.id;
+
+        for (int i = 0; i < rowCount; ++i) {
+            const bool income = i % 5 == 0;
+            ledger.batch << makeTx(1.0 + i % 13, income ? "Income" : "Expense",
+                                   income ? salary.id : ledger.categoryIds[i % 2], ledger.accountIds[i % 2],
+                                   start.addSecs(qint64(i) * 29 * 3600));
+        }
+        return db.addTransactions(ledger.batch);
+    }
+
+    // One line per row, for comparing reports as a whole.
+    static QStringList flatten(const QList<ReportRow> &rows) {
+        QStringList out;
+        for (const ReportRow &row : rows) {
+            out << QString("%1/%2/%3/%4=%5x%6").arg(row.categoryId).arg(row.accountId).arg(row.type)
+                   .arg(row.month).arg(row.total.toString()).arg(row.count);
+        }
+        return out;
+    }
 };
 
 // -------------------- Init edge cases --------------------
@@ -124,6 +235,117 @@ void DatabaseTests::db_init_invalidPath_fails() {
     QVERIFY(!db.init("/tmp/this/path/should/not/exist_12345/ledger.db"));
 }
 
+void DatabaseTests::db_init_freshDatabase_reachesLatestSchema() {
+    TestEnv env;
+    QCOMPARE(env.db.schemaVersion(), Database::latestSchemaVersion());
+}
+
+void DatabaseTests::db_init_legacyDatabase_migratedInPlace() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create temp dir");
+    const QString dbPath = QDir(dir.path()).filePath("legacy.db");
+
+    // Recreate a ledger.db as written before schema versioning existed.
+    {
+        QSqlDatabase legacy = QSqlDatabase::addDatabase("QSQLITE", "legacy_setup");
+        legacy.setDatabaseName(dbPath);
+        QVERIFY(legacy.open());
+        QSqlQuery q(legacy);
+        QVERIFY(q.exec("CREATE TABLE transactions (id INTEGER PRIMARY KEY AUTOINCREMENT, amount REAL NOT NULL, "
+                       "type TEXT NOT NULL, categoryId INTEGER, accountId INTEGER NOT NULL, time TEXT NOT NULL, note TEXT)"));
+        QVERIFY(q.exec("CREATE TABLE accounts (id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT NOT NULL UNIQUE, "
+                       "type TEXT NOT NULL, balance REAL NOT NULL DEFAULT 0)"));
+        QVERIFY(q.exec("INSERT INTO accounts (name, type, balance) VALUES ('Old', 'Cash', 5)"));
+        QVERIFY(q.exec("INSERT INTO transactions (amount, type, categoryId, accountId, time, note) "
+                       "VALUES (5, 'Income', 1, 1, '2025-12-01T10:00:00', 'legacy')"));
+        q.finish();
+        legacy.close();
+    }
+    QSqlDatabase::removeDatabase("legacy_setup");
+
+    {
+        Database db;
+        QVERIFY(db.init(dbPath));
+        QCOMPARE(db.schemaVersion(), Database::latestSchemaVersion());
+        const QList<Transaction> migrated = db.findTransactions(QString());
+        QCOMPARE(migrated.size(), 1);
+        QCOMPARE(migrated[0].time, QDateTime(QDate(2025, 12, 1), QTime(10, 0)));
+        QCOMPARE(db.getAllAccounts().size(), 1);
+        QCOMPARE(db.getAllAccounts()[0].balance, Money::fromMinor(500));
+        QCOMPARE(migrated[0].amount, Money::fromMinor(500));
+        // The legacy balance is taken as correct when the opening balance is derived.
+        QCOMPARE(driftCount(db.verifyBalances()), 0);
+    }
+
+    {
+        QSqlDatabase check = QSqlDatabase::addDatabase("QSQLITE", "legacy_check");
+        check.setDatabaseName(dbPath);
+        QVERIFY(check.open());
+        QSqlQuery q(check);
+        QVERIFY(q.exec("SELECT COUNT(*) FROM sqlite_master WHERE type = 'index' "
+                       "AND name = 'idx_transactions_spend'"));
+        QVERIFY(q.next());
+        QCOMPARE(q.value(0).toInt(), 1);
+        q.finish();
+        QVERIFY(q.exec("SELECT typeof(time), month FROM transactions"));
+        QVERIFY(q.next());
+        QCOMPARE(q.value(0).toString(), QStringLiteral("integer"));
+        QCOMPARE(q.value(1).toInt(), 202512);
+        q.finish();
+        check.close();
+    }
+    QSqlDatabase::removeDatabase("legacy_check");
+}
+
+void DatabaseTests::db_init_defaultOptions_keepRollbackJournal() {
+    TestEnv env;
+    const DatabaseOptions active = env.db.activeOptions();
+    QCOMPARE(active.journalMode, QString("DELETE"));
+    QCOMPARE(active.synchronous, QString("FULL"));
+}
+
+void DatabaseTests::db_init_balancedProfile_enablesWal() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create temp dir");
+    Database db;
+    QVERIFY(db.init(QDir(dir.path()).filePath("wal.db"), DatabaseOptions::balanced()));
+
+    const DatabaseOptions active = db.activeOptions();
+    QCOMPARE(active.journalMode, QString("WAL"));
+    QCOMPARE(active.synchronous, QString("NORMAL"));
+    QCOMPARE(active.cacheSizeKiB, DatabaseOptions::balanced().cacheSizeKiB);
+}
+
+void DatabaseTests::db_init_defaultOptions_leaveWalFileInWal() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create temp dir");
+    const QString path = QDir(dir.path()).filePath("wal.db");
+    Database writer;
+    QVERIFY(writer.init(path, DatabaseOptions::balanced()));
+    Account acc = makeAccount("A1", "Cash", 0.0);
+    QVERIFY(writer.addAccount(acc));
+
+    // A second, default-options connection opened alongside the writer
+    // must not switch the file back to a rollback journal.
+    Database other;
+    QVERIFY(other.init(path));
+    QCOMPARE(other.activeOptions().journalMode, QString("WAL"));
+    QCOMPARE(writer.activeOptions().journalMode, QString("WAL"));
+    QCOMPARE(other.getAllAccounts().size(), 1);
+}
+
+void DatabaseTests::db_init_bulkProfile_appliesCacheAndTempStore() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create temp dir");
+    Database db;
+    QVERIFY(db.init(QDir(dir.path()).filePath("bulk.db"), DatabaseOptions::bulk()));
+
+    const DatabaseOptions active = db.activeOptions();
+    QCOMPARE(active.journalMode, QString("WAL"));
+    QCOMPARE(active.cacheSizeKiB, DatabaseOptions::bulk().cacheSizeKiB);
+    QVERIFY(active.tempStoreMemory);
+}
+
 // -------------------- Accounts / Balance --------------------
 
 void DatabaseTests::account_addAccount_setsId() {
@@ -165,14 +387,14 @@ void DatabaseTests::account_updateAccount_updatesFields() {
 
     acc.name = "New";
     acc.type = "Bank";
-    acc.balance = 99.0;
+    acc.balance = Money::fromDouble(99.0);
     QVERIFY(env.db.updateAccount(acc));
 
     const QList<Account> accounts = env.db.getAllAccounts();
     QCOMPARE(accounts.size(), 1);
     QCOMPARE(accounts[0].name, QString("New"));
     QCOMPARE(accounts[0].type, QString("Bank"));
-    QCOMPARE(accounts[0].balance, 99.0);
+    QCOMPARE(accounts[0].balance, Money::fromDouble(99.0));
 }
 
 void DatabaseTests::account_updateAccount_duplicateName_fails() {
@@ -191,9 +413,9 @@ void DatabaseTests::account_updateBalance_increases() {
     Account acc = makeAccount("A", "Cash", 10.0);
     QVERIFY(env.db.addAccount(acc));
 
-    QVERIFY(env.db.updateBalance(acc.id, 2.5));
+    QVERIFY(env.db.updateBalance(acc.id, Money::fromDouble(2.5)));
     const auto accounts = env.db.getAllAccounts();
-    QCOMPARE(accounts[0].balance, 12.5);
+    QCOMPARE(accounts[0].balance, Money::fromDouble(12.5));
 }
 
 void DatabaseTests::account_updateBalance_decreases() {
@@ -201,20 +423,42 @@ void DatabaseTests::account_updateBalance_decreases() {
     Account acc = makeAccount("A", "Cash", 10.0);
     QVERIFY(env.db.addAccount(acc));
 
-    QVERIFY(env.db.updateBalance(acc.id, -3.0));
+    QVERIFY(env.db.updateBalance(acc.id, Money::fromDouble(-3.0)));
     const auto accounts = env.db.getAllAccounts();
-    QCOMPARE(accounts[0].balance, 7.0);
+    QCOMPARE(accounts[0].balance, Money::fromDouble(7.0));
 }
 
 void DatabaseTests::account_updateBalance_nonexistentId_fails() {
     TestEnv env;
-    QVERIFY(!env.db.updateBalance(9999, 10.0));
+    QVERIFY(!env.db.updateBalance(9999, Money::fromDouble(10.0)));
     QCOMPARE(env.db.getAllAccounts().size(), 0);
 }
 
 void DatabaseTests::account_updateBalance_withoutInit_fails() {
     Database db;
-    QVERIFY(!db.updateBalance(1, 1.0));
+    QVERIFY(!db.updateBalance(1, Money::fromDouble(1.0)));
+}
+
+void DatabaseTests::account_updateBalance_manyCentDeltas_noDrift() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 0.0);
+    QVERIFY(env.db.addAccount(acc));
+
+    // 0.1 has no exact binary representation; a REAL balance ends at
+    // 0.9999999999999999 after ten of these.
+    for (int i = 0; i < 10; ++i) {
+        QVERIFY(env.db.updateBalance(acc.id, Money::fromDouble(0.1)));
+    }
+    QCOMPARE(env.db.getAllAccounts()[0].balance, Money::fromMinor(100));
+}
+
+void DatabaseTests::money_fromDouble_roundsAndFormats() {
+    QCOMPARE(Money::fromDouble(12.345).minor(), qint64(1235));
+    QCOMPARE(Money::fromDouble(-0.005).minor(), qint64(-1));
+    QCOMPARE(Money::fromDouble(0.1 + 0.2), Money::fromMinor(30));
+    QCOMPARE(Money::fromMinor(123450).toString(), QStringLiteral("1234.50"));
+    QCOMPARE(Money::fromMinor(-5).toString(), QStringLiteral("-0.05"));
+    QCOMPARE(Money().toString(), QStringLiteral("0.00"));
 }
 
 void DatabaseTests::account_balance_matchesAfterTransaction_income() {
@@ -229,7 +473,7 @@ void DatabaseTests::account_balance_matchesAfterTransaction_income() {
     QVERIFY(env.db.addTransaction(tx));
 
     const auto accounts = env.db.getAllAccounts();
-    QCOMPARE(accounts[0].balance, 100.0);
+    QCOMPARE(accounts[0].balance, Money::fromDouble(100.0));
 }
 
 void DatabaseTests::account_balance_matchesAfterTransaction_expense() {
@@ -244,7 +488,7 @@ void DatabaseTests::account_balance_matchesAfterTransaction_expense() {
     QVERIFY(env.db.addTransaction(tx));
 
     const auto accounts = env.db.getAllAccounts();
-    QCOMPARE(accounts[0].balance, 30.0);
+    QCOMPARE(accounts[0].balance, Money::fromDouble(30.0));
 }
 
 void DatabaseTests::account_deleteTransaction_revertsBalance() {
@@ -257,10 +501,10 @@ void DatabaseTests::account_deleteTransaction_revertsBalance() {
 
     Transaction tx = makeTx(20.0, "Expense", cat.id, acc.id, QDateTime::currentDateTimeUtc());
     QVERIFY(env.db.addTransaction(tx));
-    QCOMPARE(env.db.getAllAccounts()[0].balance, 30.0);
+    QCOMPARE(env.db.getAllAccounts()[0].balance, Money::fromDouble(30.0));
 
     QVERIFY(env.db.deleteTransaction(tx.id));
-    QCOMPARE(env.db.getAllAccounts()[0].balance, 50.0);
+    QCOMPARE(env.db.getAllAccounts()[0].balance, Money::fromDouble(50.0));
 }
 
 // -------------------- Transactions / Budgets / Spent --------------------
@@ -354,10 +598,10 @@ void DatabaseTests::tx_addTransaction_transfer_noBalanceChange() {
 
     Transaction tx = makeTx(5.0, "Transfer", cat.id, acc.id, QDateTime::currentDateTimeUtc());
     QVERIFY(env.db.addTransaction(tx));
-    QCOMPARE(env.db.getAllAccounts()[0].balance, 10.0);
+    QCOMPARE(env.db.getAllAccounts()[0].balance, Money::fromDouble(10.0));
 
     QVERIFY(env.db.deleteTransaction(tx.id));
-    QCOMPARE(env.db.getAllAccounts()[0].balance, 10.0);
+    QCOMPARE(env.db.getAllAccounts()[0].balance, Money::fromDouble(10.0));
 }
 
 void DatabaseTests::tx_addTransaction_unknownType_failsAndNoInsert() {
@@ -370,7 +614,7 @@ void DatabaseTests::tx_addTransaction_unknownType_failsAndNoInsert() {
     Transaction tx = makeTx(5.0, "WeirdType", cat.id, acc.id, QDateTime::currentDateTimeUtc());
     QVERIFY(!env.db.addTransaction(tx));
     QCOMPARE(env.db.findTransactions(QString()).size(), 0);
-    QCOMPARE(env.db.getAllAccounts()[0].balance, 10.0);
+    QCOMPARE(env.db.getAllAccounts()[0].balance, Money::fromDouble(10.0));
 }
 
 void DatabaseTests::tx_addTransaction_badAccount_rollsBackInsert() {
@@ -392,17 +636,81 @@ void DatabaseTests::tx_updateTransaction_adjustsBalance() {
 
     Transaction tx = makeTx(10.0, "Expense", cat.id, acc.id, QDateTime::currentDateTimeUtc());
     QVERIFY(env.db.addTransaction(tx));
-    QCOMPARE(env.db.getAllAccounts()[0].balance, -10.0);
+    QCOMPARE(env.db.getAllAccounts()[0].balance, Money::fromDouble(-10.0));
 
     tx.type = "Income";
-    tx.amount = 10.0;
+    tx.amount = Money::fromDouble(10.0);
     QVERIFY(env.db.updateTransaction(tx));
-    QCOMPARE(env.db.getAllAccounts()[0].balance, 10.0);
+    QCOMPARE(env.db.getAllAccounts()[0].balance, Money::fromDouble(10.0));
+}
+
+void DatabaseTests::tx_addTransactions_batch_setsIdsAndBalances() {
+    TestEnv env;
+    Account cash = makeAccount("Cash", "Cash", 10.0);
+    Account bank = makeAccount("Bank", "Bank", 0.0);
+    QVERIFY(env.db.addAccount(cash));
+    QVERIFY(env.db.addAccount(bank));
+    Category food = makeCategory("Food", "Expense");
+    Category salary = makeCategory("Salary", "Income");
+    QVERIFY(env.db.addCategory(food));
+    QVERIFY(env.db.addCategory(salary));
+
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    QList<Transaction> batch = {
+        makeTx(3.0, "Expense", food.id, cash.id, now.addSecs(-3)),
+        makeTx(2.0, "Expense", food.id, cash.id, now.addSecs(-2)),
+        makeTx(100.0, "Income", salary.id, bank.id, now.addSecs(-1)),
+        makeTx(7.0, "Transfer", food.id, bank.id, now),
+    };
+    QVERIFY(env.db.addTransactions(batch));
+
+    for (const auto &tx : batch) {
+        QVERIFY(tx.id > 0);
+    }
+    QCOMPARE(env.db.findTransactions(QString()).size(), 4);
+
+    for (const auto &acc : env.db.getAllAccounts()) {
+        if (acc.id == cash.id) {
+            QCOMPARE(acc.balance, Money::fromDouble(5.0));
+        } else {
+            QCOMPARE(acc.balance, Money::fromDouble(100.0));
+        }
+    }
+}
+
+void DatabaseTests::tx_addTransactions_badAccount_rollsBackWholeBatch() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 10.0);
+    QVERIFY(env.db.addAccount(acc));
+    Category cat = makeCategory("Any", "Expense");
+    QVERIFY(env.db.addCategory(cat));
+
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    QList<Transaction> batch = {
+        makeTx(5.0, "Expense", cat.id, acc.id, now),
+        makeTx(5.0, "Expense", cat.id, 999999, now),
+    };
+    QVERIFY(!env.db.addTransactions(batch));
+    QCOMPARE(batch[0].id, -1);
+    QCOMPARE(env.db.findTransactions(QString()).size(), 0);
+    QCOMPARE(env.db.getAllAccounts()[0].balance, Money::fromDouble(10.0));
+
+    // Rejected up front for an unknown type, stale ids are reset all the same.
+    QList<Transaction> typo = {
+        makeTx(5.0, "Expense", cat.id, acc.id, now),
+        makeTx(5.0, "Expnese", cat.id, acc.id, now),
+    };
+    typo[0].id = 41;
+    typo[1].id = 42;
+    QVERIFY(!env.db.addTransactions(typo));
+    QCOMPARE(typo[0].id, -1);
+    QCOMPARE(typo[1].id, -1);
+    QCOMPARE(env.db.findTransactions(QString()).size(), 0);
 }
 
 void DatabaseTests::tx_calculateSpent_empty_returns0() {
     TestEnv env;
-    QCOMPARE(env.db.calculateSpent(1, 202512), 0.0);
+    QCOMPARE(env.db.calculateSpent(1, 202512), Money::fromDouble(0.0));
 }
 
 void DatabaseTests::tx_calculateSpent_onlyExpenseAndMonthCounted() {
@@ -429,7 +737,53 @@ void DatabaseTests::tx_calculateSpent_onlyExpenseAndMonthCounted() {
     QVERIFY(env.db.addTransaction(in));
     QVERIFY(env.db.addTransaction(otherMonth));
 
-    QCOMPARE(env.db.calculateSpent(food.id, 202512), 17.0);
+    QCOMPARE(env.db.calculateSpent(food.id, 202512), Money::fromDouble(17.0));
+}
+
+void DatabaseTests::tx_monthBucket_utcInputUsesLocalMonth() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 0.0);
+    QVERIFY(env.db.addAccount(acc));
+
+    // Times on either side of a month boundary, given in specs far from
+    // any local zone: whatever the zone, at least one of them falls in
+    // another month once it is read back as local time.
+    const QList<QDateTime> times = {
+        QDateTime(QDate(2025, 1, 31), QTime(23, 30), Qt::UTC),
+        QDateTime(QDate(2025, 2, 1), QTime(0, 30), Qt::OffsetFromUTC, 14 * 3600),
+        QDateTime(QDate(2025, 1, 31), QTime(23, 30), Qt::OffsetFromUTC, -12 * 3600),
+    };
+    for (const QDateTime &time : times) {
+        Category cat = makeCategory(QString("Cat %1").arg(time.toString(Qt::ISODate)), "Expense");
+        QVERIFY(env.db.addCategory(cat));
+        Transaction tx = makeTx(5.0, "Expense", cat.id, acc.id, time);
+        QVERIFY(env.db.addTransaction(tx));
+
+        const QList<Transaction> stored = env.db.findTransactions(QString("categoryId = %1").arg(cat.id));
+        QCOMPARE(stored.size(), 1);
+        const QDate shown = stored.first().time.date();
+        const int month = shown.year() * 100 + shown.month();
+        QCOMPARE(env.db.calculateSpent(cat.id, month), Money::fromDouble(5.0));
+    }
+}
+
+void DatabaseTests::tx_time_roundTripsWithMilliseconds() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 0.0);
+    QVERIFY(env.db.addAccount(acc));
+
+    // Late on the last day of the month: the month bucket follows the
+    // timestamp's own calendar date, not the next month in UTC.
+    const QDateTime when(QDate(2025, 11, 30), QTime(23, 59, 59, 250));
+    Transaction tx = makeTx(3.0, "Expense", 1, acc.id, when);
+    QVERIFY(env.db.addTransaction(tx));
+
+    const QList<Transaction> list = env.db.findTransactions(TransactionQuery());
+    QCOMPARE(list.size(), 1);
+    QCOMPARE(list[0].time, when);
+    QCOMPARE(list[0].time.time().msec(), 250);
+    QCOMPARE(env.db.calculateSpent(1, 202511), Money::fromDouble(3.0));
+    QCOMPARE(env.db.calculateSpent(1, 202512), Money::fromDouble(0.0));
 }
 
 void DatabaseTests::category_addCategory_duplicate_fails() {
@@ -462,7 +816,7 @@ void DatabaseTests::budget_setAndGetBudget_roundTrip() {
     b.id = -1;
     b.categoryId = food.id;
     b.month = 202512;
-    b.limit = 123.45;
+    b.limit = Money::fromDouble(123.45);
 
     QVERIFY(env.db.setBudget(b));
 
@@ -470,7 +824,7 @@ void DatabaseTests::budget_setAndGetBudget_roundTrip() {
     QVERIFY(loaded.id > 0);
     QCOMPARE(loaded.categoryId, food.id);
     QCOMPARE(loaded.month, 202512);
-    QCOMPARE(loaded.limit, 123.45);
+    QCOMPARE(loaded.limit, Money::fromDouble(123.45));
 }
 
 void DatabaseTests::budget_getBudget_missing_returnsSentinel() {
@@ -479,7 +833,52 @@ void DatabaseTests::budget_getBudget_missing_returnsSentinel() {
     QCOMPARE(b.id, -1);
     QCOMPARE(b.categoryId, -1);
     QCOMPARE(b.month, -1);
-    QCOMPARE(b.limit, 0.0);
+    QCOMPARE(b.limit, Money::fromDouble(0.0));
+}
+
+void DatabaseTests::budget_getBudgetReport_matchesPerCategoryCalls() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 0.0);
+    QVERIFY(env.db.addAccount(acc));
+    Category food = makeCategory("Food", "Expense");
+    Category fun = makeCategory("Fun", "Expense");
+    Category salary = makeCategory("Salary", "Income");
+    QVERIFY(env.db.addCategory(food));
+    QVERIFY(env.db.addCategory(fun));
+    QVERIFY(env.db.addCategory(salary));
+
+    Budget b;
+    b.id = -1;
+    b.categoryId = food.id;
+    b.month = 202512;
+    b.limit = Money::fromDouble(50.0);
+    QVERIFY(env.db.setBudget(b));
+    b.month = 202601;
+    QVERIFY(env.db.setBudget(b));
+
+    const QDateTime dec(QDate(2025, 12, 10), QTime(12, 0));
+    QList<Transaction> batch = {
+        makeTx(7.0, "Expense", fun.id, acc.id, dec),
+        makeTx(3.0, "Expense", fun.id, acc.id, dec.addMonths(1)),
+        makeTx(100.0, "Income", salary.id, acc.id, dec),
+    };
+    QVERIFY(env.db.addTransactions(batch));
+
+    const QList<BudgetReportRow> report = env.db.getBudgetReport(202512);
+    QCOMPARE(report.size(), 2);
+    for (const BudgetReportRow &row : report) {
+        const Budget budget = env.db.getBudget(row.categoryId, 202512);
+        QCOMPARE(row.limit.has_value(), budget.id != -1);
+        if (row.limit) {
+            QCOMPARE(*row.limit, budget.limit);
+        }
+        QCOMPARE(row.spent, env.db.calculateSpent(row.categoryId, 202512));
+    }
+    QCOMPARE(report[0].categoryName, QStringLiteral("Food"));
+    QCOMPARE(*report[0].limit, Money::fromDouble(50.0));
+    QCOMPARE(report[1].categoryName, QStringLiteral("Fun"));
+    QVERIFY(!report[1].limit);
+    QCOMPARE(report[1].spent, Money::fromDouble(7.0));
 }
 
 void DatabaseTests::tx_findTransactions_sortedByTimeDesc() {
@@ -499,6 +898,1424 @@ void DatabaseTests::tx_findTransactions_sortedByTimeDesc() {
     QVERIFY(list[0].time >= list[1].time);
 }
 
+void DatabaseTests::txQuery_typeAndAccount_matchesOnlyThose() {
+    TestEnv env;
+    Account a1 = makeAccount("A1", "Cash", 0.0);
+    Account a2 = makeAccount("A2", "Cash", 0.0);
+    QVERIFY(env.db.addAccount(a1));
+    QVERIFY(env.db.addAccount(a2));
+    Category food = makeCategory("Food", "Expense");
+    Category salary = makeCategory("Salary", "Income");
+    QVERIFY(env.db.addCategory(food));
+    QVERIFY(env.db.addCategory(salary));
+
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    QList<Transaction> batch = {
+        makeTx(1.0, "Expense", food.id, a1.id, now),
+        makeTx(2.0, "Expense", food.id, a2.id, now),
+        makeTx(3.0, "Income", salary.id, a1.id, now),
+    };
+    QVERIFY(env.db.addTransactions(batch));
+
+    TransactionQuery q;
+    q.type = "Expense";
+    q.accountIds = {a1.id};
+    const auto list = env.db.findTransactions(q);
+    QCOMPARE(list.size(), 1);
+    QCOMPARE(list[0].id, batch[0].id);
+}
+
+void DatabaseTests::txQuery_timeRangeOrderAndLimit() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 0.0);
+    QVERIFY(env.db.addAccount(acc));
+    Category food = makeCategory("Food", "Expense");
+    QVERIFY(env.db.addCategory(food));
+
+    const QDateTime base(QDate(2025, 12, 1), QTime(9, 0), Qt::UTC);
+    QList<Transaction> batch;
+    for (int day = 0; day < 10; ++day) {
+        batch << makeTx(1.0 + day, "Expense", food.id, acc.id, base.addDays(day));
+    }
+    QVERIFY(env.db.addTransactions(batch));
+
+    TransactionQuery q;
+    q.from = base.addDays(2);
+    q.to = base.addDays(8);
+    q.minAmount = Money::fromDouble(4.0);
+    q.order = TransactionQuery::Order::OldestFirst;
+    q.limit = 3;
+    const auto list = env.db.findTransactions(q);
+    QCOMPARE(list.size(), 3);
+    QCOMPARE(list[0].amount, Money::fromDouble(4.0));
+    QCOMPARE(list[1].amount, Money::fromDouble(5.0));
+    QCOMPARE(list[2].amount, Money::fromDouble(6.0));
+}
+
+void DatabaseTests::txQuery_noteContains_treatsWildcardsLiterally() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 0.0);
+    QVERIFY(env.db.addAccount(acc));
+    Category food = makeCategory("Food", "Expense");
+    QVERIFY(env.db.addCategory(food));
+
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    QList<Transaction> batch = {
+        makeTx(1.0, "Expense", food.id, acc.id, now, "100% beef"),
+        makeTx(1.0, "Expense", food.id, acc.id, now, "100 beef"),
+        makeTx(1.0, "Expense", food.id, acc.id, now, "lunch'; DROP TABLE transactions; --"),
+    };
+    QVERIFY(env.db.addTransactions(batch));
+
+    TransactionQuery q;
+    q.noteContains = "0%";
+    QCOMPARE(env.db.findTransactions(q).size(), 1);
+
+    TransactionQuery prefix;
+    prefix.notePrefix = "lunch'";
+    QCOMPARE(env.db.findTransactions(prefix).size(), 1);
+    QCOMPARE(env.db.findTransactions(TransactionQuery()).size(), 3);
+}
+
+void DatabaseTests::txQuery_sameShape_reusesStatement() {
+    TestEnv env;
+    TransactionQuery q;
+    q.type = "Expense";
+    q.categoryIds = {1, 2};
+    env.db.findTransactions(q);
+
+    const StatementCacheStats before = env.db.statementCacheStats();
+    q.type = "Income";
+    q.categoryIds = {3, 4};
+    env.db.findTransactions(q);
+    const StatementCacheStats after = env.db.statementCacheStats();
+    QCOMPARE(after.misses, before.misses);
+    QCOMPARE(after.hits - before.hits, quint64(1));
+}
+
+void DatabaseTests::page_forwardAndBackward_walkAllRows() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 0.0);
+    QVERIFY(env.db.addAccount(acc));
+    Category food = makeCategory("Food", "Expense");
+    QVERIFY(env.db.addCategory(food));
+
+    // Pairs of rows share a timestamp so the id tie-break is exercised.
+    const QDateTime base(QDate(2025, 12, 1), QTime(9, 0), Qt::UTC);
+    QList<Transaction> batch;
+    for (int i = 0; i < 7; ++i) {
+        batch << makeTx(1.0, "Expense", food.id, acc.id, base.addSecs(60 * (i / 2)));
+    }
+    QVERIFY(env.db.addTransactions(batch));
+
+    const TransactionQuery all;
+    QList<int> forwardIds;
+    TransactionCursor cursor;
+    TransactionPage page;
+    do {
+        page = env.db.findTransactionsPage(all, cursor, 3);
+        for (const auto &tx : page.rows) forwardIds << tx.id;
+        cursor = page.last;
+    } while (page.hasMore);
+    QList<int> expectedIds;
+    for (const auto &tx : env.db.findTransactions(all)) expectedIds << tx.id;
+    QCOMPARE(expectedIds.size(), 7);
+    QCOMPARE(forwardIds, expectedIds);
+
+    // Walking back from the last page start returns the preceding rows in order.
+    const TransactionPage previous = env.db.findTransactionsPage(all, page.first, 3, PageDirection::Backward);
+    QCOMPARE(previous.rows.size(), 3);
+    QCOMPARE(previous.rows.last().id, forwardIds[forwardIds.size() - page.rows.size() - 1]);
+    QVERIFY(previous.hasMore);
+}
+
+void DatabaseTests::page_concurrentInsert_doesNotShiftNextPage() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 0.0);
+    QVERIFY(env.db.addAccount(acc));
+    Category food = makeCategory("Food", "Expense");
+    QVERIFY(env.db.addCategory(food));
+
+    const QDateTime base(QDate(2025, 12, 1), QTime(9, 0), Qt::UTC);
+    QList<Transaction> batch;
+    for (int i = 0; i < 4; ++i) {
+        batch << makeTx(1.0, "Expense", food.id, acc.id, base.addDays(i));
+    }
+    QVERIFY(env.db.addTransactions(batch));
+
+    const TransactionPage first = env.db.findTransactionsPage(TransactionQuery(), TransactionCursor(), 2);
+    QCOMPARE(first.rows.size(), 2);
+
+    Transaction newest = makeTx(9.0, "Expense", food.id, acc.id, base.addDays(30));
+    QVERIFY(env.db.addTransaction(newest));
+
+    const TransactionPage second = env.db.findTransactionsPage(TransactionQuery(), first.last, 2);
+    QCOMPARE(second.rows.size(), 2);
+    QCOMPARE(second.rows[0].id, batch[1].id);
+    QCOMPARE(second.rows[1].id, batch[0].id);
+    QVERIFY(!second.hasMore);
+}
+
+void DatabaseTests::page_countTransactions_matchesFilter() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 0.0);
+    QVERIFY(env.db.addAccount(acc));
+    Category food = makeCategory("Food", "Expense");
+    Category salary = makeCategory("Salary", "Income");
+    QVERIFY(env.db.addCategory(food));
+    QVERIFY(env.db.addCategory(salary));
+
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    QList<Transaction> batch = {
+        makeTx(1.0, "Expense", food.id, acc.id, now),
+        makeTx(2.0, "Expense", food.id, acc.id, now),
+        makeTx(3.0, "Income", salary.id, acc.id, now),
+    };
+    QVERIFY(env.db.addTransactions(batch));
+
+    TransactionQuery expenses;
+    expenses.type = "Expense";
+    QCOMPARE(env.db.countTransactions(expenses), 2);
+    QCOMPARE(env.db.countTransactions(TransactionQuery()), 3);
+}
+
+void DatabaseTests::stream_forEachTransaction_visitsInQueryOrder() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 0.0);
+    QVERIFY(env.db.addAccount(acc));
+    Category food = makeCategory("Food", "Expense");
+    QVERIFY(env.db.addCategory(food));
+
+    const QDateTime base(QDate(2025, 12, 1), QTime(9, 0), Qt::UTC);
+    QList<Transaction> batch;
+    for (int i = 0; i < 5; ++i) {
+        batch << makeTx(1.0 + i, "Expense", food.id, acc.id, base.addDays(i));
+    }
+    QVERIFY(env.db.addTransactions(batch));
+
+    TransactionQuery q;
+    q.order = TransactionQuery::Order::OldestFirst;
+    QList<int> visited;
+    Money total;
+    QVERIFY(env.db.forEachTransaction(q, [&](const Transaction &tx) {
+        visited << tx.id;
+        total += tx.amount;
+        return true;
+    }));
+    QCOMPARE(visited.size(), 5);
+    QCOMPARE(visited.first(), batch.first().id);
+    QCOMPARE(visited.last(), batch.last().id);
+    QCOMPARE(total, Money::fromDouble(15.0));
+}
+
+void DatabaseTests::stream_forEachTransaction_stopsEarly() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 0.0);
+    QVERIFY(env.db.addAccount(acc));
+    Category food = makeCategory("Food", "Expense");
+    QVERIFY(env.db.addCategory(food));
+
+    QList<Transaction> batch;
+    for (int i = 0; i < 10; ++i) {
+        batch << makeTx(1.0, "Expense", food.id, acc.id, QDateTime::currentDateTimeUtc());
+    }
+    QVERIFY(env.db.addTransactions(batch));
+
+    int seen = 0;
+    QVERIFY(env.db.forEachTransaction(TransactionQuery(), [&](const Transaction &) {
+        return ++seen < 3;
+    }));
+    QCOMPARE(seen, 3);
+}
+
+void DatabaseTests::stmtCache_repeatedCalls_reusePreparedStatement() {
+    TestEnv env;
+    Category food = makeCategory("Food", "Expense");
+    QVERIFY(env.db.addCategory(food));
+
+    const StatementCacheStats before = env.db.statementCacheStats();
+    for (int i = 0; i < 5; ++i) {
+        env.db.getBudget(food.id, 202512);
+    }
+    const StatementCacheStats after = env.db.statementCacheStats();
+    QCOMPARE(after.misses - before.misses, quint64(1));
+    QCOMPARE(after.hits - before.hits, quint64(4));
+}
+
+void DatabaseTests::stmtCache_reopen_invalidatesStatements() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 1.0);
+    QVERIFY(env.db.addAccount(acc));
+    QCOMPARE(env.db.getAllAccounts().size(), 1);
+
+    QVERIFY(env.db.init(env.dbPath));
+    const StatementCacheStats before = env.db.statementCacheStats();
+    QCOMPARE(env.db.getAllAccounts().size(), 1);
+    QCOMPARE(env.db.statementCacheStats().misses - before.misses, quint64(1));
+}
+
+void DatabaseTests::stmtCache_manyShapes_evictLeastRecentlyUsed() {
+    TestEnv env;
+    Category food = makeCategory("Food", "Expense");
+    QVERIFY(env.db.addCategory(food));
+    env.db.getBudget(food.id, 202512);
+
+    // Every combination of filters is a shape of its own.
+    for (int mask = 0; mask < 128; ++mask) {
+        TransactionQuery q;
+        if (mask & 1) q.from = QDateTime(QDate(2025, 1, 1), QTime(0, 0), Qt::UTC);
+        if (mask & 2) q.to = QDateTime(QDate(2026, 1, 1), QTime(0, 0), Qt::UTC);
+        if (mask & 4) q.accountIds = {1};
+        if (mask & 8) q.categoryIds = {food.id};
+        if (mask & 16) q.type = "Expense";
+        if (mask & 32) q.minAmount = Money::fromMinor(1);
+        if (mask & 64) q.noteContains = "x";
+        QVERIFY(env.db.findTransactions(q).isEmpty());
+        QVERIFY(env.db.statementCacheStats().cached <= 64);
+    }
+
+    StatementCacheStats before = env.db.statementCacheStats();
+    TransactionQuery newest;
+    newest.from = QDateTime(QDate(2025, 1, 1), QTime(0, 0), Qt::UTC);
+    newest.to = QDateTime(QDate(2026, 1, 1), QTime(0, 0), Qt::UTC);
+    newest.accountIds = {1};
+    newest.categoryIds = {food.id};
+    newest.type = "Expense";
+    newest.minAmount = Money::fromMinor(1);
+    newest.noteContains = "x";
+    env.db.findTransactions(newest);
+    QCOMPARE(env.db.statementCacheStats().hits - before.hits, quint64(1));
+
+    before = env.db.statementCacheStats();
+    env.db.getBudget(food.id, 202512);
+    QCOMPARE(env.db.statementCacheStats().misses - before.misses, quint64(1));
+}
+
+void DatabaseTests::stmtCache_archiveFold_keepsUnrelatedStatements() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 0.0);
+    QVERIFY(env.db.addAccount(acc));
+    Category food = makeCategory("Food", "Expense");
+    QVERIFY(env.db.addCategory(food));
+
+    const int thisYear = QDateTime::currentDateTimeUtc().date().year();
+    const int firstYear = thisYear - 11;
+    QList<Transaction> batch;
+    for (int year = firstYear; year < thisYear - 1; ++year) {
+        batch << makeTx(5.0, "Expense", food.id, acc.id, QDateTime(QDate(year, 6, 10), QTime(12, 0), Qt::UTC));
+    }
+    QVERIFY(env.db.addTransactions(batch));
+    env.db.getBudget(food.id, 202512);
+
+    // Past eight files each fold detaches the archive folded away.
+    for (int year = firstYear; year < thisYear - 1; ++year) {
+        QVERIFY(env.db.archiveYear(year));
+    }
+    QCOMPARE(env.db.countTransactions(TransactionQuery()), 10);
+    const StatementCacheStats before = env.db.statementCacheStats();
+    env.db.getBudget(food.id, 202512);
+    const StatementCacheStats after = env.db.statementCacheStats();
+    QCOMPARE(after.misses, before.misses);
+    QCOMPARE(after.hits - before.hits, quint64(1));
+}
+
+void DatabaseTests::rollup_writes_keepRollupConsistent() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 0.0);
+    QVERIFY(env.db.addAccount(acc));
+    Category food = makeCategory("Food", "Expense");
+    Category fun = makeCategory("Fun", "Expense");
+    QVERIFY(env.db.addCategory(food));
+    QVERIFY(env.db.addCategory(fun));
+
+    const QDateTime dec(QDate(2025, 12, 10), QTime(12, 0));
+    Transaction a = makeTx(10.0, "Expense", food.id, acc.id, dec);
+    Transaction b = makeTx(4.0, "Expense", food.id, acc.id, dec.addDays(1));
+    QVERIFY(env.db.addTransaction(a));
+    QVERIFY(env.db.addTransaction(b));
+    QList<Transaction> batch = {
+        makeTx(1.5, "Expense", fun.id, acc.id, dec),
+        makeTx(2.5, "Expense", fun.id, acc.id, dec.addMonths(1)),
+    };
+    QVERIFY(env.db.addTransactions(batch));
+
+    // Move b to another category and month, then delete a.
+    b.categoryId = fun.id;
+    b.time = dec.addMonths(1);
+    QVERIFY(env.db.updateTransaction(b));
+    QVERIFY(env.db.deleteTransaction(a.id));
+
+    QCOMPARE(env.db.calculateSpent(food.id, 202512), Money());
+    QCOMPARE(env.db.calculateSpent(fun.id, 202512), Money::fromDouble(1.5));
+    QCOMPARE(env.db.calculateSpent(fun.id, 202601), Money::fromDouble(6.5));
+    QVERIFY(env.db.verifySpendRollup().isEmpty());
+}
+
+void DatabaseTests::rollup_verify_reportsDriftAndRebuildRepairs() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 0.0);
+    QVERIFY(env.db.addAccount(acc));
+    Category food = makeCategory("Food", "Expense");
+    QVERIFY(env.db.addCategory(food));
+    Transaction tx = makeTx(10.0, "Expense", food.id, acc.id, QDateTime(QDate(2025, 12, 10), QTime(12, 0)));
+    QVERIFY(env.db.addTransaction(tx));
+
+    {
+        QSqlDatabase raw = QSqlDatabase::addDatabase("QSQLITE", "rollup_tamper");
+        raw.setDatabaseName(env.dbPath);
+        QVERIFY(raw.open());
+        QSqlQuery q(raw);
+        QVERIFY(q.exec("UPDATE spend_rollup SET total = total + 1"));
+        q.finish();
+        raw.close();
+    }
+    QSqlDatabase::removeDatabase("rollup_tamper");
+
+    const QList<RollupDrift> drift = env.db.verifySpendRollup();
+    QCOMPARE(drift.size(), 1);
+    QCOMPARE(drift[0].categoryId, food.id);
+    QCOMPARE(drift[0].month, 202512);
+    QCOMPARE(drift[0].storedTotal, Money::fromMinor(1001));
+    QCOMPARE(drift[0].actualTotal, Money::fromMinor(1000));
+
+    QVERIFY(env.db.rebuildSpendRollup());
+    QVERIFY(env.db.verifySpendRollup().isEmpty());
+    QCOMPARE(env.db.calculateSpent(food.id, 202512), Money::fromDouble(10.0));
+}
+
+void DatabaseTests::cache_categoryName_warmLookupsRunNoStatements() {
+    TestEnv env;
+    Category food = makeCategory("Food", "Expense");
+    QVERIFY(env.db.addCategory(food));
+
+    QCOMPARE(env.db.categoryName(food.id), QStringLiteral("Food"));
+    const StatementCacheStats before = env.db.statementCacheStats();
+    for (int i = 0; i < 100; ++i) {
+        QCOMPARE(env.db.categoryName(food.id), QStringLiteral("Food"));
+    }
+    QVERIFY(env.db.categoryName(9999).isEmpty());
+    const StatementCacheStats after = env.db.statementCacheStats();
+    QCOMPARE(after.hits + after.misses, before.hits + before.misses);
+
+    // Written through once the cache is warm.
+    Category fun = makeCategory("Fun", "Expense");
+    QVERIFY(env.db.addCategory(fun));
+    QCOMPARE(env.db.categoryName(fun.id), QStringLiteral("Fun"));
+}
+
+void DatabaseTests::cache_accountWrites_areWrittenThrough() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 10.0);
+    QVERIFY(env.db.addAccount(acc));
+    QVERIFY(env.db.account(acc.id).has_value());
+
+    Account renamed = acc;
+    renamed.name = "B";
+    QVERIFY(env.db.updateAccount(renamed));
+    QCOMPARE(env.db.account(acc.id)->name, QStringLiteral("B"));
+
+    Category cat = makeCategory("Food", "Expense");
+    QVERIFY(env.db.addCategory(cat));
+    Transaction tx = makeTx(4.0, "Expense", cat.id, acc.id, QDateTime::currentDateTimeUtc());
+    QVERIFY(env.db.addTransaction(tx));
+    QCOMPARE(env.db.account(acc.id)->balance, Money::fromDouble(6.0));
+    QCOMPARE(env.db.account(acc.id)->balance, env.db.getAllAccounts()[0].balance);
+
+    Account other = makeAccount("C", "Bank", 0.0);
+    QVERIFY(env.db.addAccount(other));
+    QCOMPARE(env.db.account(other.id)->name, QStringLiteral("C"));
+    QVERIFY(!env.db.account(9999));
+}
+
+void DatabaseTests::cache_rolledBackBatch_doesNotLeakBalances() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 10.0);
+    QVERIFY(env.db.addAccount(acc));
+    Category cat = makeCategory("Food", "Expense");
+    QVERIFY(env.db.addCategory(cat));
+    QCOMPARE(env.db.account(acc.id)->balance, Money::fromDouble(10.0));
+
+    // acc's balance is updated before the unknown account fails the batch.
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    QList<Transaction> batch = {
+        makeTx(5.0, "Expense", cat.id, acc.id, now),
+        makeTx(5.0, "Expense", cat.id, 999999, now),
+    };
+    QVERIFY(!env.db.addTransactions(batch));
+    QCOMPARE(env.db.account(acc.id)->balance, Money::fromDouble(10.0));
+}
+
+void DatabaseTests::async_operations_runInOrderOnWorkerThread() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create temp dir");
+    AsyncDatabase adb;
+    QFuture<bool> opened = adb.init(QDir(dir.path()).filePath("async.db"));
+
+    // Issued back to back without waiting: each must see the previous one.
+    QFuture<int> added = adb.addAccount(makeAccount("A", "Cash", 10.0));
+    QFuture<QList<Account>> accounts = adb.getAllAccounts();
+    QFuture<QThread *> workerThread = adb.run([](Database &) { return QThread::currentThread(); });
+
+    QVERIFY(opened.result());
+    QVERIFY(added.result() > 0);
+    QCOMPARE(accounts.result().size(), 1);
+    QCOMPARE(accounts.result().first().id, added.result());
+    QVERIFY(workerThread.result() != QThread::currentThread());
+
+    bool delivered = false;
+    AsyncDatabase::whenFinished(this, adb.calculateSpent(1, 202512), [&delivered](Money spent) {
+        QVERIFY(spent.isZero());
+        delivered = true;
+    });
+    QTRY_VERIFY(delivered);
+}
+
+void DatabaseTests::async_cancel_skipsQueuedOperation() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create temp dir");
+    AsyncDatabase adb;
+    QVERIFY(adb.init(QDir(dir.path()).filePath("async.db")).result());
+
+    // Hold the worker so the next operation is still queued when cancelled.
+    QSemaphore started;
+    QSemaphore release;
+    QFuture<bool> blocker = adb.run([&started, &release](Database &) {
+        started.release();
+        release.acquire();
+        return true;
+    });
+    QFuture<int> skipped = adb.addAccount(makeAccount("Skipped", "Cash", 1.0));
+    started.acquire();
+    skipped.cancel();
+    release.release();
+
+    QVERIFY(blocker.result());
+    QFuture<QList<Account>> accounts = adb.getAllAccounts();
+    QVERIFY(accounts.result().isEmpty());
+    QVERIFY(skipped.isCanceled());
+}
+
+void DatabaseTests::async_backup_writesProceedDuringCopy() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create temp dir");
+    AsyncDatabase adb;
+    QVERIFY(adb.init(QDir(dir.path()).filePath("async.db"), DatabaseOptions::balanced()).result());
+    const int accId = adb.addAccount(makeAccount("A", "Cash", 100.0)).result();
+    const int catId = adb.addCategory(makeCategory("Food", "Expense")).result();
+    const QDateTime base(QDate(2025, 6, 1), QTime(9, 0), Qt::UTC);
+    QVERIFY(adb.run([accId, catId, base](Database &db) {
+        QList<Transaction> batch;
+        for (int i = 0; i < 20000; ++i) {
+            batch << makeTx(1.0, "Expense", catId, accId, base.addSecs(i));
+        }
+        return db.addTransactions(batch);
+    }).result());
+
+    // The worker is free again as soon as it has handed the copy over, so
+    // writes queued behind the backup land before it is done.
+    const QString target = QDir(dir.path()).filePath("ledger-copy.db");
+    QFuture<bool> backup = adb.backupTo(target);
+    int duringCopy = 0;
+    int added = 0;
+    while (!backup.isFinished()) {
+        const int id = adb.addTransaction(makeTx(2.0, "Expense", catId, accId, base.addDays(1))).result();
+        QVERIFY(id > 0);
+        ++added;
+        if (!backup.isFinished()) {
+            ++duringCopy;
+        }
+    }
+    QVERIFY(backup.result());
+    QVERIFY(duringCopy > 0);
+    QVERIFY(backup.progressMaximum() > 0);
+    QCOMPARE(backup.progressValue(), backup.progressMaximum());
+
+    // The copy holds every row written before the backup was asked for.
+    Database copy(nullptr);
+    QVERIFY(copy.init(target));
+    const int copied = copy.countTransactions(TransactionQuery());
+    QVERIFY(copied >= 20000 && copied <= 20000 + added);
+    QCOMPARE(driftCount(copy.verifyBalances()), 0);
+    QCOMPARE(adb.countTransactions(TransactionQuery()).result(), 20000 + added);
+}
+
+void DatabaseTests::readPool_readersArePerThreadAndReadOnly() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create temp dir");
+    const QString path = QDir(dir.path()).filePath("pool.db");
+    Database writer;
+    QVERIFY(writer.init(path, DatabaseOptions::balanced()));
+    Account acc = makeAccount("A", "Cash", 0.0);
+    QVERIFY(writer.addAccount(acc));
+    Category food = makeCategory("Food", "Expense");
+    QVERIFY(writer.addCategory(food));
+    Transaction tx = makeTx(12.5, "Expense", food.id, acc.id, QDateTime(QDate(2025, 12, 3), QTime(9, 0), Qt::UTC));
+    QVERIFY(writer.addTransaction(tx));
+
+    ReadPool pool(path);
+    Database *mine = pool.reader();
+    QVERIFY(mine);
+    QCOMPARE(pool.reader(), mine);
+    QCOMPARE(mine->calculateSpent(food.id, 202512), Money::fromDouble(12.5));
+
+    Database *theirs = nullptr;
+    Money theirSpent;
+    QScopedPointer<QThread> thread(QThread::create([&]() {
+        theirs = pool.reader();
+        if (theirs) {
+            theirSpent = theirs->calculateSpent(food.id, 202512);
+        }
+    }));
+    thread->start();
+    QVERIFY(thread->wait(10000));
+    QVERIFY(theirs);
+    QVERIFY(theirs != mine);
+    QCOMPARE(theirSpent, Money::fromDouble(12.5));
+    // The finished thread's reader was closed with it.
+    QCOMPARE(pool.size(), 1);
+
+    Account rejected = makeAccount("B", "Cash", 0.0);
+    QVERIFY(!mine->addAccount(rejected));
+    QCOMPARE(writer.getAllAccounts().size(), 1);
+}
+
+void DatabaseTests::readPool_snapshot_isStableWhileWriterCommits() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create temp dir");
+    const QString path = QDir(dir.path()).filePath("pool.db");
+    Database writer;
+    QVERIFY(writer.init(path, DatabaseOptions::balanced()));
+    Account acc = makeAccount("A", "Cash", 0.0);
+    QVERIFY(writer.addAccount(acc));
+    Category food = makeCategory("Food", "Expense");
+    QVERIFY(writer.addCategory(food));
+    const QDateTime dec03(QDate(2025, 12, 3), QTime(9, 0), Qt::UTC);
+    Transaction t1 = makeTx(10.0, "Expense", food.id, acc.id, dec03);
+    QVERIFY(writer.addTransaction(t1));
+
+    ReadPool pool(path);
+    Database *reader = pool.reader();
+    QVERIFY(reader);
+    QCOMPARE(reader->categoryName(food.id), QString("Food"));
+
+    QVERIFY(reader->beginSnapshot());
+    QCOMPARE(reader->calculateSpent(food.id, 202512), Money::fromDouble(10.0));
+    // Under WAL the writer commits while the snapshot is held.
+    Transaction t2 = makeTx(5.0, "Expense", food.id, acc.id, dec03);
+    QVERIFY(writer.addTransaction(t2));
+    Category rent = makeCategory("Rent", "Expense");
+    QVERIFY(writer.addCategory(rent));
+    QCOMPARE(reader->calculateSpent(food.id, 202512), Money::fromDouble(10.0));
+    reader->endSnapshot();
+
+    QCOMPARE(reader->calculateSpent(food.id, 202512), Money::fromDouble(15.0));
+    // The reader's cached categories notice the writer's commit.
+    QCOMPARE(reader->categoryName(rent.id), QString("Rent"));
+}
+
+void DatabaseTests::writeQueue_groupCommit_keepsPerItemAtomicity() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create temp dir");
+    AsyncDatabase adb;
+    QVERIFY(adb.init(QDir(dir.path()).filePath("queue.db")).result());
+    const int accId = adb.addAccount(makeAccount("A", "Cash", 100.0)).result();
+    const int catId = adb.addCategory(makeCategory("Food", "Expense")).result();
+    QVERIFY(accId > 0);
+    QVERIFY(catId > 0);
+
+    // A long delay, so only the size bound and flush() commit batches.
+    WriteQueue queue(adb, 4, 60000);
+    const QDateTime dec03(QDate(2025, 12, 3), QTime(9, 0), Qt::UTC);
+    QList<QFuture<int>> ids;
+    ids << queue.addTransaction(makeTx(1.0, "Expense", catId, accId, dec03))
+        << queue.addTransaction(makeTx(2.0, "Expense", catId, 999999, dec03)) // unknown account
+        << queue.addTransaction(makeTx(3.0, "Expense", catId, accId, dec03))
+        << queue.addTransaction(makeTx(4.0, "Bogus", catId, accId, dec03))
+        << queue.addTransaction(makeTx(5.0, "Income", catId, accId, dec03))
+        << queue.addTransaction(makeTx(6.0, "Expense", catId, accId, dec03));
+    queue.flush();
+
+    QVERIFY(ids[0].result() > 0);
+    QCOMPARE(ids[1].result(), -1);
+    QVERIFY(ids[2].result() > 0);
+    QCOMPARE(ids[3].result(), -1);
+    QVERIFY(ids[4].result() > 0);
+    QVERIFY(ids[5].result() > 0);
+
+    const WriteQueueStats stats = queue.stats();
+    QCOMPARE(stats.batches, quint64(2));
+    QCOMPARE(stats.items, quint64(6));
+    QCOMPARE(stats.largestBatch, 4);
+    QVERIFY(stats.maxLatencyUs >= 0);
+
+    const QList<Account> accounts = adb.getAllAccounts().result();
+    QCOMPARE(accounts.size(), 1);
+    QCOMPARE(accounts.first().balance, Money::fromDouble(100.0 - 1.0 - 3.0 + 5.0 - 6.0));
+    QCOMPARE(adb.calculateSpent(catId, 202512).result(), Money::fromDouble(10.0));
+    QVERIFY(adb.run([](Database &db) { return db.verifySpendRollup(); }).result().isEmpty());
+}
+
+void DatabaseTests::writeQueue_maxDelay_flushesPartialBatch() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create temp dir");
+    AsyncDatabase adb;
+    QVERIFY(adb.init(QDir(dir.path()).filePath("queue.db")).result());
+    const int accId = adb.addAccount(makeAccount("A", "Cash", 0.0)).result();
+    const int catId = adb.addCategory(makeCategory("Salary", "Income")).result();
+
+    WriteQueue queue(adb, 100, 10);
+    QFuture<int> id = queue.addTransaction(makeTx(7.0, "Income", catId, accId, QDateTime::currentDateTimeUtc()));
+    QTRY_VERIFY(id.isFinished());
+    QVERIFY(id.result() > 0);
+    QCOMPARE(queue.stats().batches, quint64(1));
+}
+
+void DatabaseTests::notes_search_matchesPrefixesAndFollowsWrites() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 0.0);
+    QVERIFY(env.db.addAccount(acc));
+    Category food = makeCategory("Food", "Expense");
+    QVERIFY(env.db.addCategory(food));
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    Transaction aldi = makeTx(1.0, "Expense", food.id, acc.id, now, "Groceries at Aldi");
+    Transaction twice = makeTx(2.0, "Expense", food.id, acc.id, now, "grocery run, groceries again");
+    Transaction rent = makeTx(3.0, "Expense", food.id, acc.id, now, "Rent");
+    Transaction empty = makeTx(4.0, "Expense", food.id, acc.id, now);
+    QVERIFY(env.db.addTransaction(aldi));
+    QVERIFY(env.db.addTransaction(twice));
+    QVERIFY(env.db.addTransaction(rent));
+    QVERIFY(env.db.addTransaction(empty));
+
+    QList<NoteMatch> matches = env.db.searchNotes("groc");
+    QCOMPARE(matches.size(), 2);
+    for (const NoteMatch &m : matches) {
+        QVERIFY(m.transaction.id == aldi.id || m.transaction.id == twice.id);
+        QVERIFY(m.snippet.contains("[groc", Qt::CaseInsensitive));
+    }
+    if (env.db.hasNoteIndex()) {
+        // More hits in a shorter note rank first.
+        QCOMPARE(matches.first().transaction.id, twice.id);
+    }
+    QCOMPARE(env.db.searchNotes("groc ald").size(), 1);
+    QVERIFY(env.db.searchNotes("   ").isEmpty());
+    // FTS5 syntax in the input is matched literally, not parsed.
+    QVERIFY(env.db.searchNotes("\"AND OR* NEAR(").isEmpty());
+
+    rent.note = "Rent and groceries";
+    QVERIFY(env.db.updateTransaction(rent));
+    QCOMPARE(env.db.searchNotes("groc").size(), 3);
+    QVERIFY(env.db.deleteTransaction(aldi.id));
+    matches = env.db.searchNotes("groc");
+    QCOMPARE(matches.size(), 2);
+    for (const NoteMatch &m : matches) {
+        QVERIFY(m.transaction.id != aldi.id);
+    }
+    QCOMPARE(env.db.searchNotes("rent").first().transaction.amount, Money::fromDouble(3.0));
+}
+
+void DatabaseTests::balances_verify_findsDriftAcrossRangesAndRepairFixesIt() {
+    TestEnv env;
+    Category food = makeCategory("Food", "Expense");
+    QVERIFY(env.db.addCategory(food));
+    Category salary = makeCategory("Salary", "Income");
+    QVERIFY(env.db.addCategory(salary));
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    QList<int> accountIds;
+    for (int i = 0; i < 20; ++i) {
+        Account acc = makeAccount(QString("Acc %1").arg(i), "Cash", 10.0 * i);
+        QVERIFY(env.db.addAccount(acc));
+        accountIds.append(acc.id);
+        Transaction in = makeTx(100.0, "Income", salary.id, acc.id, now);
+        Transaction out = makeTx(1.25 * i, "Expense", food.id, acc.id, now);
+        QVERIFY(env.db.addTransaction(in));
+        QVERIFY(env.db.addTransaction(out));
+    }
+    // Setting a balance by hand moves the opening balance, it is not drift.
+    Account edited = *env.db.account(accountIds[3]);
+    edited.balance = Money::fromDouble(42.0);
+    QVERIFY(env.db.updateAccount(edited));
+
+    ReadPool pool(env.dbPath, DatabaseOptions());
+    {
+        BalanceVerifier verifier(pool, 4);
+        QCOMPARE(driftCount(verifier.verify()), 0);
+    }
+
+    // Corrupt two balances behind Database's back.
+    {
+        QSqlDatabase raw = QSqlDatabase::addDatabase("QSQLITE", "balance_corrupt");
+        raw.setDatabaseName(env.dbPath);
+        QVERIFY(raw.open());
+        QSqlQuery q(raw);
+        QVERIFY(q.exec(QString("UPDATE accounts SET balance = balance + 7 WHERE id = %1").arg(accountIds[1])));
+        QVERIFY(q.exec(QString("UPDATE accounts SET balance = balance - 3 WHERE id = %1").arg(accountIds[18])));
+        q.finish();
+        raw.close();
+    }
+    QSqlDatabase::removeDatabase("balance_corrupt");
+
+    QList<BalanceDrift> drift;
+    {
+        BalanceVerifier verifier(pool, 4);
+        const std::optional<QList<BalanceDrift>> found = verifier.verify();
+        QVERIFY(found);
+        drift = *found;
+    }
+    QCOMPARE(drift.size(), 2);
+    QCOMPARE(drift[0].accountId, accountIds[1]);
+    QCOMPARE(drift[0].storedBalance, Money::fromMinor(1000 + 10000 - 125 + 7));
+    QCOMPARE(drift[0].expectedBalance, Money::fromMinor(1000 + 10000 - 125));
+    QCOMPARE(drift[1].accountId, accountIds[18]);
+    QCOMPARE(driftCount(env.db.verifyBalances()), 2);
+
+    QVERIFY(env.db.repairBalances({drift[0].accountId, drift[1].accountId}));
+    QCOMPARE(driftCount(env.db.verifyBalances()), 0);
+    QCOMPARE(env.db.account(accountIds[1])->balance, drift[0].expectedBalance);
+    QCOMPARE(env.db.account(accountIds[3])->balance, Money::fromDouble(42.0));
+
+    // A check that cannot read reports failure, not a clean ledger.
+    ReadPool missing(QDir(env.tempDir.path()).filePath("missing.db"));
+    BalanceVerifier unreadable(missing, 2);
+    QVERIFY(!unreadable.verify());
+}
+
+void DatabaseTests::balances_asOf_checkpointsFollowBackdatedWrites() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 100.0);
+    QVERIFY(env.db.addAccount(acc));
+    Account other = makeAccount("B", "Cash", 0.0);
+    QVERIFY(env.db.addAccount(other));
+    Category food = makeCategory("Food", "Expense");
+    QVERIFY(env.db.addCategory(food));
+    Category salary = makeCategory("Salary", "Income");
+    QVERIFY(env.db.addCategory(salary));
+
+    const auto utc = [](int y, int m, int d) { return QDateTime(QDate(y, m, d), QTime(12, 0), Qt::UTC); };
+    Transaction jan = makeTx(500.0, "Income", salary.id, acc.id, utc(2025, 1, 10));
+    Transaction feb = makeTx(20.0, "Expense", food.id, acc.id, utc(2025, 2, 10));
+    Transaction mar = makeTx(30.0, "Expense", food.id, acc.id, utc(2025, 3, 20));
+    QVERIFY(env.db.addTransaction(jan));
+    QVERIFY(env.db.addTransaction(feb));
+    QVERIFY(env.db.addTransaction(mar));
+
+    // Reference value straight from the transaction log.
+    Money opening = Money::fromDouble(100.0);
+    const auto expectedAsOf = [&](const QDateTime &at) {
+        TransactionQuery q;
+        q.accountIds = {acc.id};
+        q.to = at;
+        Money balance = opening;
+        for (const Transaction &tx : env.db.findTransactions(q)) {
+            balance += tx.type == "Income" ? tx.amount : -tx.amount;
+        }
+        return balance;
+    };
+    const auto checkpointCount = [&]() {
+        QSqlDatabase raw = QSqlDatabase::addDatabase("QSQLITE", "checkpoint_count");
+        raw.setDatabaseName(env.dbPath);
+        int count = -1;
+        if (raw.open()) {
+            QSqlQuery q(raw);
+            if (q.exec(QString("SELECT COUNT(*) FROM balance_checkpoints WHERE accountId = %1").arg(acc.id)) && q.next()) {
+                count = q.value(0).toInt();
+            }
+        }
+        raw = QSqlDatabase();
+        QSqlDatabase::removeDatabase("checkpoint_count");
+        return count;
+    };
+    const QList<QDateTime> probes = {utc(2024, 12, 31), utc(2025, 1, 31), utc(2025, 3, 1),
+                                     utc(2025, 3, 15), utc(2025, 4, 2), utc(2026, 1, 1)};
+    const auto checkAll = [&]() {
+        for (const QDateTime &at : probes) {
+            const std::optional<Money> balance = env.db.balanceAsOf(acc.id, at);
+            if (!balance || *balance != expectedAsOf(at)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    QVERIFY(checkAll());
+    QVERIFY(env.db.refreshBalanceCheckpoints(utc(2025, 4, 15)));
+    // After each month with rows: Feb 1, Mar 1, Apr 1.
+    QCOMPARE(checkpointCount(), 3);
+    QVERIFY(checkAll());
+    QCOMPARE(*env.db.balanceAsOf(acc.id, utc(2026, 1, 1)), env.db.account(acc.id)->balance);
+    QVERIFY(!env.db.balanceAsOf(999999, utc(2025, 1, 1)));
+
+    // A backdated insert drops the checkpoints after it, and only those.
+    Transaction lateFeb = makeTx(5.0, "Expense", food.id, acc.id, utc(2025, 2, 27));
+    QVERIFY(env.db.addTransaction(lateFeb));
+    QCOMPARE(checkpointCount(), 1);
+    QVERIFY(checkAll());
+    QVERIFY(env.db.refreshBalanceCheckpoints(utc(2025, 4, 15)));
+    QCOMPARE(checkpointCount(), 3);
+    QVERIFY(checkAll());
+
+    // Moving a row back a month, deleting one and moving one to another account.
+    mar.time = utc(2025, 1, 20);
+    QVERIFY(env.db.updateTransaction(mar));
+    QVERIFY(checkAll());
+    QVERIFY(env.db.refreshBalanceCheckpoints(utc(2025, 4, 15)));
+    QVERIFY(env.db.deleteTransaction(feb.id));
+    QVERIFY(checkAll());
+    QVERIFY(env.db.refreshBalanceCheckpoints(utc(2025, 4, 15)));
+    jan.accountId = other.id;
+    QVERIFY(env.db.updateTransaction(jan));
+    QVERIFY(checkAll());
+    QCOMPARE(*env.db.balanceAsOf(other.id, utc(2026, 1, 1)), Money::fromDouble(500.0));
+
+    // A hand-set balance moves the opening balance.
+    QVERIFY(env.db.refreshBalanceCheckpoints(utc(2025, 4, 15)));
+    Account edited = *env.db.account(acc.id);
+    opening += Money::fromDouble(250.0) - edited.balance;
+    edited.balance = Money::fromDouble(250.0);
+    QVERIFY(env.db.updateAccount(edited));
+    QCOMPARE(checkpointCount(), 0);
+    QVERIFY(checkAll());
+    QCOMPARE(*env.db.balanceAsOf(acc.id, utc(2026, 1, 1)), Money::fromDouble(250.0));
+}
+
+void DatabaseTests::archive_year_movesRowsAndQueriesFanOut() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 100.0);
+    QVERIFY(env.db.addAccount(acc));
+    Category food = makeCategory("Food", "Expense");
+    QVERIFY(env.db.addCategory(food));
+    Category salary = makeCategory("Salary", "Income");
+    QVERIFY(env.db.addCategory(salary));
+
+    const int thisYear = QDateTime::currentDateTimeUtc().date().year();
+    const int closed = thisYear - 2;
+    const auto utc = [](int y, int m, int d) { return QDateTime(QDate(y, m, d), QTime(12, 0), Qt::UTC); };
+    Transaction older = makeTx(200.0, "Income", salary.id, acc.id, utc(closed - 1, 6, 1));
+    Transaction march = makeTx(20.0, "Expense", food.id, acc.id, utc(closed, 3, 5));
+    Transaction september = makeTx(30.0, "Expense", food.id, acc.id, utc(closed, 9, 5));
+    Transaction current = makeTx(5.0, "Expense", food.id, acc.id, utc(thisYear, 1, 1));
+    QList<Transaction> batch = {older, march, september, current};
+    QVERIFY(env.db.addTransactions(batch));
+    march = batch[1];
+
+    const TransactionQuery all;
+    QList<int> expectedIds;
+    for (const auto &tx : env.db.findTransactions(all)) expectedIds << tx.id;
+    const Money spentBefore = env.db.calculateSpent(food.id, closed * 100 + 3);
+
+    QVERIFY(env.db.archiveYear(closed));
+    QVERIFY(QFileInfo::exists(QDir(env.tempDir.path()).filePath(QString("test_ledger-%1.db").arg(closed))));
+    QCOMPARE(env.db.archivePartitions().size(), 1);
+    QCOMPARE(env.db.archivePartitions().first().rowCount, qint64(2));
+
+    // Full and ranged reads see archived rows; ranges that miss the year do not need it.
+    QList<int> ids;
+    for (const auto &tx : env.db.findTransactions(all)) ids << tx.id;
+    QCOMPARE(ids, expectedIds);
+    QCOMPARE(env.db.countTransactions(all), 4);
+    TransactionQuery closedYear;
+    closedYear.from = utc(closed, 1, 1);
+    closedYear.to = utc(closed + 1, 1, 1);
+    QCOMPARE(env.db.countTransactions(closedYear), 2);
+    TransactionQuery recent;
+    recent.from = utc(thisYear, 1, 1).addDays(-1);
+    QCOMPARE(env.db.countTransactions(recent), 1);
+
+    // Pages cross the boundary between the files.
+    QList<int> pagedIds;
+    TransactionCursor cursor;
+    TransactionPage page;
+    do {
+        page = env.db.findTransactionsPage(all, cursor, 3);
+        for (const auto &tx : page.rows) pagedIds << tx.id;
+        cursor = page.last;
+    } while (page.hasMore);
+    QCOMPARE(pagedIds, expectedIds);
+
+    // Spend, balances and their checks are unchanged.
+    QCOMPARE(env.db.calculateSpent(food.id, closed * 100 + 3), spentBefore);
+    QCOMPARE(driftCount(env.db.verifyBalances()), 0);
+    QVERIFY(env.db.verifySpendRollup().isEmpty());
+    QCOMPARE(*env.db.balanceAsOf(acc.id, utc(closed, 12, 31)), Money::fromDouble(250.0));
+    QVERIFY(env.db.refreshBalanceCheckpoints(utc(thisYear, 1, 1)));
+    QCOMPARE(*env.db.balanceAsOf(acc.id, utc(closed, 12, 31)), Money::fromDouble(250.0));
+
+    // The open year stays put, and archived rows are read-only.
+    QVERIFY(!env.db.archiveYear(thisYear));
+    march.amount = Money::fromDouble(1.0);
+    QVERIFY(!env.db.updateTransaction(march));
+    QVERIFY(!env.db.deleteTransaction(march.id));
+
+    // A row backdated into the archived year is moved by the next run.
+    Transaction late = makeTx(7.0, "Expense", food.id, acc.id, utc(closed, 11, 1));
+    QVERIFY(env.db.addTransaction(late));
+    QCOMPARE(env.db.countTransactions(closedYear), 3);
+    QVERIFY(env.db.archiveYear(closed));
+    QCOMPARE(env.db.archivePartitions().first().rowCount, qint64(3));
+    QCOMPARE(env.db.countTransactions(closedYear), 3);
+    QCOMPARE(driftCount(env.db.verifyBalances()), 0);
+
+    // The registry lives in the main file.
+    Database reopened(nullptr);
+    QVERIFY(reopened.init(env.dbPath));
+    QCOMPARE(reopened.archivePartitions().size(), 1);
+    QCOMPARE(reopened.countTransactions(all), 5);
+}
+
+void DatabaseTests::archive_manyYears_foldsOldFilesAndReadsAll() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 0.0);
+    QVERIFY(env.db.addAccount(acc));
+    Category food = makeCategory("Food", "Expense");
+    QVERIFY(env.db.addCategory(food));
+
+    // Eleven closed years, more than SQLite can attach at once.
+    const int thisYear = QDateTime::currentDateTimeUtc().date().year();
+    const int firstYear = thisYear - 12;
+    const auto utc = [](int y, int m, int d) { return QDateTime(QDate(y, m, d), QTime(12, 0), Qt::UTC); };
+    QList<Transaction> batch;
+    for (int year = firstYear; year < thisYear - 1; ++year) {
+        for (int month : {3, 6, 9}) {
+            batch << makeTx(month, "Expense", food.id, acc.id, utc(year, month, 10));
+        }
+    }
+    batch << makeTx(1.0, "Expense", food.id, acc.id, utc(thisYear, 1, 1));
+    QVERIFY(env.db.addTransactions(batch));
+    const TransactionQuery all;
+    QList<int> expectedIds;
+    for (const auto &tx : env.db.findTransactions(all)) expectedIds << tx.id;
+    QCOMPARE(expectedIds.size(), 34);
+
+    for (int year = firstYear; year < thisYear - 1; ++year) {
+        QVERIFY(env.db.archiveYear(year));
+    }
+    const QList<ArchivePartition> partitions = env.db.archivePartitions();
+    QCOMPARE(partitions.size(), 11);
+    QSet<QString> fileNames;
+    for (const ArchivePartition &partition : partitions) {
+        QCOMPARE(partition.rowCount, qint64(3));
+        fileNames.insert(partition.fileName);
+    }
+    QVERIFY(fileNames.size() <= 8);
+    // Folded files are gone; the newest years keep a file each.
+    const QStringList onDisk = QDir(env.tempDir.path()).entryList({"test_ledger-*.db"}, QDir::Files);
+    QCOMPARE(onDisk.size(), fileNames.size());
+    QCOMPARE(partitions.last().fileName, QString("test_ledger-%1.db").arg(thisYear - 2));
+
+    // Unbounded reads span every year, folded ones included.
+    QList<int> ids;
+    for (const auto &tx : env.db.findTransactions(all)) ids << tx.id;
+    QCOMPARE(ids, expectedIds);
+    QCOMPARE(env.db.countTransactions(all), 34);
+    TransactionQuery firstOnly;
+    firstOnly.from = utc(firstYear, 1, 1);
+    firstOnly.to = utc(firstYear + 1, 1, 1);
+    QCOMPARE(env.db.countTransactions(firstOnly), 3);
+    QList<int> pagedIds;
+    TransactionCursor cursor;
+    TransactionPage page;
+    do {
+        page = env.db.findTransactionsPage(all, cursor, 5);
+        for (const auto &tx : page.rows) pagedIds << tx.id;
+        cursor = page.last;
+    } while (page.hasMore);
+    QCOMPARE(pagedIds, expectedIds);
+    QCOMPARE(driftCount(env.db.verifyBalances()), 0);
+    QVERIFY(env.db.verifySpendRollup().isEmpty());
+    QVERIFY(env.db.loadSpendCube());
+    QVERIFY(env.db.beginSnapshot());
+    QCOMPARE(env.db.countTransactions(all), 34);
+    env.db.endSnapshot();
+
+    Database reopened(nullptr);
+    QVERIFY(reopened.init(env.dbPath));
+    QCOMPARE(reopened.countTransactions(all), 34);
+}
+
+void DatabaseTests::backup_whileWriting_copiesConsistentSnapshot() {
+    TestEnv env;
+    QVERIFY(env.db.init(env.dbPath, DatabaseOptions::balanced()));
+    Account acc = makeAccount("A", "Cash", 100.0);
+    QVERIFY(env.db.addAccount(acc));
+    Category food = makeCategory("Food", "Expense");
+    QVERIFY(env.db.addCategory(food));
+    const QDateTime base(QDate(2025, 6, 1), QTime(9, 0), Qt::UTC);
+    QList<Transaction> batch;
+    for (int i = 0; i < 5000; ++i) {
+        batch << makeTx(1.0, "Expense", food.id, acc.id, base.addSecs(i));
+    }
+    QVERIFY(env.db.addTransactions(batch));
+
+    // A second connection keeps writing while the copy runs.
+    Database writer(nullptr);
+    QVERIFY(writer.init(env.dbPath, DatabaseOptions::balanced()));
+    const QString target = QDir(env.tempDir.path()).filePath("backup/ledger-copy.db");
+    QVERIFY(QDir().mkpath(QFileInfo(target).path()));
+    QList<BackupProgress> reports;
+    int added = 0;
+    bool writesOk = true;
+    QVERIFY(env.db.backupTo(target, [&](const BackupProgress &progress) {
+        reports << progress;
+        Transaction tx = makeTx(2.0, "Expense", food.id, acc.id, base.addDays(1));
+        writesOk = writer.addTransaction(tx) && writesOk;
+        ++added;
+    }));
+    QVERIFY(writesOk);
+    QVERIFY(!reports.isEmpty());
+    for (const BackupProgress &progress : reports) {
+        QVERIFY(progress.bytesCopied <= progress.totalBytes);
+    }
+    QVERIFY(reports.last().bytesCopied > 0);
+    QCOMPARE(reports.last().bytesCopied, QFileInfo(target).size());
+    QCOMPARE(reports.last().totalBytes, reports.last().bytesCopied);
+
+    // The copy is one committed state: whole batches, matching balances.
+    Database copy(nullptr);
+    QVERIFY(copy.init(target));
+    const int copied = copy.countTransactions(TransactionQuery());
+    QVERIFY(copied >= 5000 && copied <= 5000 + added);
+    QCOMPARE(driftCount(copy.verifyBalances()), 0);
+    QVERIFY(copy.verifySpendRollup().isEmpty());
+
+    QVERIFY(!env.db.backupTo(target));
+}
+
+void DatabaseTests::columns_aggregates_matchSqlAndFollowWrites() {
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 0.0);
+    QVERIFY(env.db.addAccount(acc));
+    Category food = makeCategory("Food", "Expense");
+    QVERIFY(env.db.addCategory(food));
+    Category fuel = makeCategory("Fuel", "Expense");
+    QVERIFY(env.db.addCategory(fuel));
+    Category salary = makeCategory("Salary", "Income");
+    QVERIFY(env.db.addCategory(salary));
+
+    const QDateTime base(QDate(2025, 1, 15), QTime(12, 0));
+    QList<Transaction> batch;
+    for (int i = 0; i < 60; ++i) {
+        const int categoryId = i % 3 == 0 ? fuel.id : food.id;
+        batch << makeTx(1.0 + i, "Expense", categoryId, acc.id, base.addDays(7 * i), i % 2 ? "Shop" : "Market");
+    }
+    batch << makeTx(900.0, "Income", salary.id, acc.id, base, "Salary");
+    QVERIFY(env.db.addTransactions(batch));
+    QVERIFY(!env.db.columnStore());
+    QVERIFY(env.db.loadColumnStore());
+    const ColumnStore *store = env.db.columnStore();
+    QVERIFY(store);
+    QCOMPARE(store->size(), 61);
+    QCOMPARE(store->distinctNotes(), 3);
+
+    // Every month and category total agrees with the SQL side.
+    const qint64 from = std::numeric_limits<qint64>::min();
+    const qint64 to = std::numeric_limits<qint64>::max();
+    const auto matchesSql = [&]() {
+        const auto byMonth = store->totalsByMonth(ColumnStore::Expense, from, to);
+        Money all;
+        for (auto it = byMonth.constBegin(); it != byMonth.constEnd(); ++it) {
+            if (it.value().total != env.db.calculateSpent(food.id, it.key())
+                    + env.db.calculateSpent(fuel.id, it.key())) {
+                return false;
+            }
+            all += it.value().total;
+        }
+        const auto byCategory = store->totalsByCategory(ColumnStore::Expense, from, to);
+        Money categories;
+        for (auto it = byCategory.constBegin(); it != byCategory.constEnd(); ++it) {
+            categories += it.value().total;
+        }
+        TransactionQuery expenses;
+        expenses.type = "Expense";
+        Money fromRows;
+        for (const Transaction &tx : env.db.findTransactions(expenses)) fromRows += tx.amount;
+        return all == fromRows && categories == fromRows;
+    };
+    QVERIFY(matchesSql());
+    const auto income = store->totalsByCategory(ColumnStore::Income, from, to);
+    QCOMPARE(income.size(), 1);
+    QCOMPARE(income.value(salary.id).total, Money::fromDouble(900.0));
+
+    // Ranges are half-open on time.
+    const qint64 start = base.toMSecsSinceEpoch();
+    const auto firstWeek = store->totalsByCategory(ColumnStore::Expense, start, start + 7LL * 24 * 3600 * 1000);
+    QCOMPARE(firstWeek.size(), 1);
+    QCOMPARE(firstWeek.value(fuel.id).count, qint64(1));
+
+    // Committed writes are applied; rolled-back ones are not.
+    Transaction extra = makeTx(5.0, "Expense", food.id, acc.id, base.addDays(3), "Kiosk");
+    QVERIFY(env.db.addTransaction(extra));
+    batch[1].amount = Money::fromDouble(42.0);
+    batch[1].categoryId = fuel.id;
+    QVERIFY(env.db.updateTransaction(batch[1]));
+    QVERIFY(env.db.deleteTransaction(batch[2].id));
+    Transaction orphan = makeTx(5.0, "Expense", food.id, 999999, base);
+    QVERIFY(!env.db.addTransaction(orphan));
+    QCOMPARE(store->size(), 61);
+    QCOMPARE(store->distinctNotes(), 4);
+    QVERIFY(matchesSql());
+
+    // So is a delete whose commit fails: a reader holding the rollback
+    // journal file's shared lock makes it give up after the busy timeout.
+    {
+        Database reader;
+        QVERIFY(reader.init(env.dbPath));
+        QVERIFY(reader.beginSnapshot());
+        QVERIFY(!env.db.deleteTransaction(batch[3].id));
+        reader.endSnapshot();
+    }
+    QCOMPARE(store->size(), 61);
+    QVERIFY(matchesSql());
+}
+
+void DatabaseTests::kernels_everyIsa_matchesScalarAndRollup() {
+    // Odd row counts leave tails for the vector loops; edges sit on row
+    // times to pin down the half-open buckets.
+    QRandomGenerator random(23);
+    const int rows = 1003;
+    QVector<qint64> amounts(rows), times(rows);
+    QVector<quint8> types(rows);
+    QVector<qint32> keys(rows);
+    for (int i = 0; i < rows; ++i) {
+        amounts[i] = random.bounded(-500, 5000);
+        times[i] = random.bounded(0, 1000);
+        types[i] = quint8(random.bounded(0, 3));
+        keys[i] = 10 + random.bounded(0, 7);
+    }
+    const AggregateKernels::Columns columns{amounts.constData(), times.constData(), types.constData(), rows};
+    qint64 edges[] = {times[0], 250, 251, times[1] + 1, 900};
+    std::sort(std::begin(edges), std::end(edges));
+
+    const auto grid = [&](AggregateKernels::Isa isa, int edgeCount) {
+        QVector<qint64> cells(7 * 4 * 2, 0);
+        AggregateKernels::sumByKeyAndTime(columns, ColumnStore::Expense, keys.constData(), 10, edges, edgeCount,
+                                          cells.data(), cells.data() + 7 * 4, isa);
+        return cells;
+    };
+    QVector<qint64> expected(7 * 4 * 2, 0);
+    for (int i = 0; i < rows; ++i) {
+        if (types[i] != ColumnStore::Expense || times[i] < edges[0] || times[i] >= edges[4]) continue;
+        int bucket = 0;
+        while (times[i] >= edges[bucket + 1]) ++bucket;
+        expected[(keys[i] - 10) * 4 + bucket] += amounts[i];
+        ++expected[7 * 4 + (keys[i] - 10) * 4 + bucket];
+    }
+    for (auto isa : {AggregateKernels::Isa::Scalar, AggregateKernels::Isa::Sse42, AggregateKernels::Isa::Avx2}) {
+        QCOMPARE(grid(isa, 5), expected);
+    }
+
+    // A year of rows summed per category and month agrees with the rollup.
+    TestEnv env;
+    Account acc = makeAccount("A", "Cash", 0.0);
+    QVERIFY(env.db.addAccount(acc));
+    QList<int> categoryIds;
+    for (const char *name : {"Food", "Fuel", "Rent"}) {
+        Category cat = makeCategory(name, "Expense");
+        QVERIFY(env.db.addCategory(cat));
+        categoryIds << cat.id;
+    }
+    QList<Transaction> batch;
+    const QDateTime start(QDate(2024, 12, 31), QTime(23, 0));
+    for (int i = 0; i < 500; ++i) {
+        batch << makeTx(1.0 + i % 17, "Expense", categoryIds[i % 3], acc.id, start.addSecs(qint64(i) * 19 * 3600));
+    }
+    QVERIFY(env.db.addTransactions(batch));
+    QVERIFY(env.db.loadColumnStore());
+    for (auto isa : {AggregateKernels::Isa::Scalar, AggregateKernels::bestIsa()}) {
+        const auto report = env.db.columnStore()->monthlyTotalsByCategory(ColumnStore::Expense, 2025, isa);
+        QCOMPARE(report.size(), 3);
+        for (int categoryId : categoryIds) {
+            for (int m = 0; m < 12; ++m) {
+                QCOMPARE(report.value(categoryId).at(m).total, env.db.calculateSpent(categoryId, 202501 + m));
+            }
+        }
+    }
+}
+
+void DatabaseTests::report_parallel_matchesSerialAndRollup() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create temp dir");
+    const QString path = QDir(dir.path()).filePath("report.db");
+    Database writer;
+    QVERIFY(writer.init(path, DatabaseOptions::balanced()));
+
+    // Three years of rows, the first of them archived.
+    ReportLedger ledger;
+    QVERIFY(seedReportLedger(writer, QDateTime(QDate(2021, 1, 1), QTime(6, 0)), 900, ledger));
+    QVERIFY(writer.archiveYear(2021));
+
+    const auto countOf = [](const QList<ReportRow> &rows) {
+        qint64 count = 0;
+        for (const ReportRow &row : rows) count += row.count;
+        return count;
+    };
+
+    ReadPool pool(path);
+    ReportEngine serial(pool, 1);
+    ReportEngine parallel(pool, 4);
+    const std::optional<QList<ReportRow>> full = parallel.run();
+    QVERIFY(full);
+    QCOMPARE(countOf(*full), qint64(900));
+    const std::optional<QList<ReportRow>> fromSerial = serial.run();
+    QVERIFY(fromSerial);
+    QCOMPARE(flatten(*full), flatten(*fromSerial));
+    const std::optional<QList<ReportRow>> fromWriter = writer.aggregateTransactions(
+        std::numeric_limits<qint64>::min(), std::numeric_limits<qint64>::max());
+    QVERIFY(fromWriter);
+    QCOMPARE(flatten(*full), flatten(*fromWriter));
+    Database closed(nullptr);
+    QVERIFY(!closed.aggregateTransactions(0, 1));
+
+    // An empty range or an empty ledger is an empty report; a ledger that
+    // cannot be read is no report at all.
+    const std::optional<QList<ReportRow>> future = parallel.run(
+        AllDimensions, QDateTime(QDate(2030, 1, 1), QTime(0, 0)), QDateTime(QDate(2031, 1, 1), QTime(0, 0)));
+    QVERIFY(future);
+    QVERIFY(future->isEmpty());
+    const QString emptyPath = QDir(dir.path()).filePath("empty.db");
+    {
+        Database empty;
+        QVERIFY(empty.init(emptyPath));
+    }
+    ReadPool emptyPool(emptyPath);
+    const std::optional<QList<ReportRow>> none = ReportEngine(emptyPool, 2).run();
+    QVERIFY(none);
+    QVERIFY(none->isEmpty());
+    ReadPool missing(QDir(dir.path()).filePath("missing.db"));
+    QVERIFY(!ReportEngine(missing, 2).run());
+
+    // Months cut by slice bounds are merged back into the rollup's cells.
+    const std::optional<QList<ReportRow>> monthly = parallel.run(ByCategory | ByType | ByMonth);
+    QVERIFY(monthly);
+    for (const ReportRow &row : *monthly) {
+        QCOMPARE(row.accountId, 0);
+        if (row.type == "Expense") {
+            QCOMPARE(row.total, writer.calculateSpent(row.categoryId, row.month));
+        }
+    }
+
+    TransactionQuery year;
+    year.from = QDateTime(QDate(2022, 1, 1), QTime(0, 0));
+    year.to = QDateTime(QDate(2023, 1, 1), QTime(0, 0));
+    const std::optional<QList<ReportRow>> ranged = parallel.run(ByAccount, year.from, year.to);
+    QVERIFY(ranged);
+    QCOMPARE(ranged->size(), 2);
+    QCOMPARE(countOf(*ranged), qint64(writer.countTransactions(year)));
+
+    const std::optional<QList<ReportRow>> total = parallel.run(0);
+    QVERIFY(total);
+    QCOMPARE(total->size(), 1);
+    QCOMPARE(total->first().count, qint64(900));
+}
+
+void DatabaseTests::cube_rollUps_followWritesAndPersist() {
+    QTemporaryDir dir;
+    QVERIFY2(dir.isValid(), "Failed to create temp dir");
+    const QString path = QDir(dir.path()).filePath("cube.db");
+    const QString cachePath = QDir(dir.path()).filePath("cube.bin");
+    Database writer;
+    QVERIFY(writer.init(path, DatabaseOptions::balanced()));
+    ReportLedger ledger;
+    QVERIFY(seedReportLedger(writer, QDateTime(QDate(2024, 1, 1), QTime(6, 0)), 400, ledger));
+    const QList<int> &accountIds = ledger.accountIds;
+    const QList<int> &categoryIds = ledger.categoryIds;
+    const QList<Transaction> &batch = ledger.batch;
+
+    // Flattened like the cube's rows; a failed read matches none of them.
+    const auto fromSql = [&writer](int dimensions) {
+        const std::optional<QList<ReportRow>> rows = writer.aggregateTransactions(
+            std::numeric_limits<qint64>::min(), std::numeric_limits<qint64>::max(), dimensions);
+        return rows ? flatten(*rows) : QStringList{QStringLiteral("unreadable")};
+    };
+    const int shapes[] = {AllDimensions, ByCategory | ByMonth, ByAccount | ByType, 0};
+
+    QVERIFY(writer.loadSpendCube());
+    const SpendCube *cube = writer.spendCube();
+    QVERIFY(cube);
+    for (int dimensions : shapes) {
+        QCOMPARE(flatten(cube->rollUp(dimensions)), fromSql(dimensions));
+    }
+
+    // One account's spending over a quarter, per category.
+    CubeSlice slice;
+    slice.accountIds << accountIds[0];
+    slice.types << "Expense";
+    slice.fromMonth = 202404;
+    slice.toMonth = 202406;
+    QMap<int, Money> expected;
+    for (const Transaction &tx : batch) {
+        const int month = tx.time.date().year() * 100 + tx.time.date().month();
+        if (tx.accountId == accountIds[0] && tx.type == "Expense" && month >= 202404 && month <= 202406) {
+            expected[tx.categoryId] += tx.amount;
+        }
+    }
+    const QList<ReportRow> sliced = cube->rollUp(ByCategory, slice);
+    QCOMPARE(sliced.size(), expected.size());
+    for (const ReportRow &row : sliced) {
+        QCOMPARE(row.accountId, 0);
+        QCOMPARE(row.month, 0);
+        QCOMPARE(row.total, expected.value(row.categoryId));
+    }
+
+    // Each write through the writer moves the cube with it.
+    Transaction extra = makeTx(42.0, "Expense", categoryIds[0], accountIds[1],
+                               QDateTime(QDate(2026, 3, 5), QTime(9, 0)));
+    QVERIFY(writer.addTransaction(extra));
+    Transaction moved = batch[3];
+    moved.accountId = accountIds[0];
+    moved.categoryId = categoryIds[0];
+    moved.time = moved.time.addDays(40);
+    QVERIFY(writer.updateTransaction(moved));
+    QVERIFY(writer.deleteTransaction(batch[7].id));
+    for (int dimensions : shapes) {
+        QCOMPARE(flatten(cube->rollUp(dimensions)), fromSql(dimensions));
+    }
+
+    // A saved cube is picked up as it is while it agrees with the tables.
+    QVERIFY(writer.saveSpendCube(cachePath));
+    {
+        Database reader;
+        QVERIFY(reader.init(path, DatabaseOptions::balanced()));
+        QVERIFY(reader.loadSpendCube(cachePath));
+        QCOMPARE(flatten(reader.spendCube()->rollUp(AllDimensions)), fromSql(AllDimensions));
+    }
+
+    // Written to behind its back, it is rebuilt and saved again.
+    {
+        Database other;
+        QVERIFY(other.init(path, DatabaseOptions::balanced()));
+        Transaction late = makeTx(7.0, "Income", ledger.salaryId, accountIds[0],
+                                  QDateTime(QDate(2026, 4, 1), QTime(9, 0)));
+        QVERIFY(other.addTransaction(late));
+    }
+    Database reopened;
+    QVERIFY(reopened.init(path, DatabaseOptions::balanced()));
+    QVERIFY(reopened.loadSpendCube(cachePath));
+    QCOMPARE(flatten(reopened.spendCube()->rollUp(AllDimensions)), fromSql(AllDimensions));
+    SpendCube saved;
+    QVERIFY(saved.load(cachePath));
+    QCOMPARE(flatten(saved.rollUp(AllDimensions)), fromSql(AllDimensions));
+    QCOMPARE(saved.generation(), *writer.writeGeneration());
+
+    // Moving a Transfer to the other account changes no rollup cell and no
+    // balance; only the write generation shows the saved cube is stale.
+    Transaction transfer = makeTx(5.0, "Transfer", categoryIds[1], accountIds[0],
+                                  QDateTime(QDate(2026, 5, 2), QTime(9, 0)));
+    QVERIFY(reopened.addTransaction(transfer));
+    QVERIFY(reopened.saveSpendCube(cachePath));
+    {
+        Database other;
+        QVERIFY(other.init(path, DatabaseOptions::balanced()));
+        const std::optional<qint64> before = other.writeGeneration();
+        QVERIFY(before);
+        transfer.accountId = accountIds[1];
+        QVERIFY(other.updateTransaction(transfer));
+        QCOMPARE(*other.writeGeneration(), *before + 1);
+    }
+    Database afterTransfer;
+    QVERIFY(afterTransfer.init(path, DatabaseOptions::balanced()));
+    QVERIFY(afterTransfer.loadSpendCube(cachePath));
+    QCOMPARE(flatten(afterTransfer.spendCube()->rollUp(AllDimensions)), fromSql(AllDimensions));
+}
+
 // -------------------- Integration tests --------------------
 
 void DatabaseTests::it_endToEnd_budgetVsSpent() {
@@ -513,7 +2330,7 @@ void DatabaseTests::it_endToEnd_budgetVsSpent() {
     b.id = -1;
     b.categoryId = food.id;
     b.month = 202512;
-    b.limit = 50.0;
+    b.limit = Money::fromDouble(50.0);
     QVERIFY(env.db.setBudget(b));
 
     const QDateTime dec02(QDate(2025, 12, 2), QTime(8, 0), Qt::UTC);
@@ -522,8 +2339,8 @@ void DatabaseTests::it_endToEnd_budgetVsSpent() {
     QVERIFY(env.db.addTransaction(t1));
     QVERIFY(env.db.addTransaction(t2));
 
-    const double spent = env.db.calculateSpent(food.id, 202512);
-    QCOMPARE(spent, 25.0);
+    const Money spent = env.db.calculateSpent(food.id, 202512);
+    QCOMPARE(spent, Money::fromDouble(25.0));
 
     const Budget loaded = env.db.getBudget(food.id, 202512);
     QVERIFY(loaded.limit >= spent);
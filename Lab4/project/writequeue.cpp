@@ -0,0 +1,115 @@
+#include "writequeue.h"
+
+#include <QMutexLocker>
+#include <QThread>
+
+WriteQueue::WriteQueue(AsyncDatabase &db, int maxBatchSize, int maxDelayMs, QObject *parent)
+    : QObject(parent)
+    , db(db)
+    , maxBatchSize(qMax(maxBatchSize, 1))
+    , maxDelayMs(qMax(maxDelayMs, 0))
+    , delayTimer(this)
+{
+    delayTimer.setSingleShot(true);
+    connect(&delayTimer, &QTimer::timeout, this, &WriteQueue::flush);
+    clock.start();
+}
+
+WriteQueue::~WriteQueue()
+{
+    // Batches refer to this object's counters, so every one has to land.
+    flush();
+    QFuture<bool> last;
+    {
+        QMutexLocker locker(&mutex);
+        last = lastBatch;
+    }
+    last.waitForFinished();
+}
+
+QFuture<int> WriteQueue::addTransaction(const Transaction &tx)
+{
+    Item item{tx, QFutureInterface<int>(), clock.nsecsElapsed()};
+    item.promise.reportStarted();
+    const QFuture<int> future = item.promise.future();
+
+    bool full = false;
+    bool first = false;
+    {
+        QMutexLocker locker(&mutex);
+        pending.append(item);
+        full = pending.size() >= maxBatchSize;
+        first = pending.size() == 1;
+    }
+    if (full) {
+        flush();
+    } else if (first) {
+        // The timer lives on this object's thread; callers may not.
+        if (QThread::currentThread() == thread()) {
+            delayTimer.start(maxDelayMs);
+        } else {
+            QMetaObject::invokeMethod(this, [this]() { delayTimer.start(maxDelayMs); }, Qt::QueuedConnection);
+        }
+    }
+    return future;
+}
+
+void WriteQueue::flush()
+{
+    QMutexLocker locker(&mutex);
+    if (pending.isEmpty()) {
+        return;
+    }
+    QList<Item> batch;
+    batch.swap(pending);
+    // Submitted under the lock so batches reach the writer in queue order.
+    lastBatch = db.run([this, batch](Database &writer) mutable {
+        commitBatch(writer, batch);
+        return true;
+    });
+}
+
+WriteQueueStats WriteQueue::stats() const
+{
+    QMutexLocker locker(&mutex);
+    return counters;
+}
+
+void WriteQueue::commitBatch(Database &writer, QList<Item> &batch)
+{
+    QList<Transaction> txs;
+    QList<int> indexes;
+    for (int i = 0; i < batch.size(); ++i) {
+        if (!batch[i].promise.isCanceled()) {
+            txs.append(batch[i].tx);
+            indexes.append(i);
+        }
+    }
+
+    QVector<bool> applied;
+    writer.addTransactionGroup(txs, applied);
+
+    const qint64 nowNs = clock.nsecsElapsed();
+    qint64 totalLatencyUs = 0;
+    qint64 maxLatencyUs = 0;
+    for (int i = 0; i < indexes.size(); ++i) {
+        Item &item = batch[indexes[i]];
+        item.promise.reportResult(applied.value(i) ? txs[i].id : -1);
+        item.promise.reportFinished();
+        const qint64 latencyUs = (nowNs - item.enqueuedNs) / 1000;
+        totalLatencyUs += latencyUs;
+        maxLatencyUs = qMax(maxLatencyUs, latencyUs);
+    }
+    for (Item &item : batch) {
+        if (item.promise.isCanceled()) {
+            item.promise.reportFinished();
+        }
+    }
+
+    QMutexLocker locker(&mutex);
+    ++counters.batches;
+    counters.items += indexes.size();
+    counters.largestBatch = qMax(counters.largestBatch, int(indexes.size()));
+    counters.totalLatencyUs += totalLatencyUs;
+    counters.maxLatencyUs = qMax(counters.maxLatencyUs, maxLatencyUs);
+}
@@ -0,0 +1,70 @@
+#ifndef WRITEQUEUE_H
+#define WRITEQUEUE_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QFutureInterface>
+#include <QList>
+#include <QMutex>
+#include <QTimer>
+
+#include "asyncdatabase.h"
+
+// Counters of WriteQueue's group commits. Latency runs from enqueue until
+// the item's future is resolved.
+struct WriteQueueStats {
+    quint64 batches = 0;
+    quint64 items = 0;
+    int largestBatch = 0;
+    qint64 totalLatencyUs = 0;
+    qint64 maxLatencyUs = 0;
+
+    double meanBatchSize() const { return batches ? double(items) / batches : 0.0; }
+    double meanLatencyUs() const { return items ? double(totalLatencyUs) / items : 0.0; }
+};
+
+// Group commit for high-rate ingestion. New transactions are queued and
+// handed to the AsyncDatabase writer in batches of up to maxBatchSize, or
+// whatever has gathered after maxDelayMs, and each batch is committed once.
+// Every transaction still goes in all or nothing on its own, with its
+// balance and rollup updates, exactly as with addTransaction().
+//
+// addTransaction() may be called from any thread. The AsyncDatabase must
+// outlive the queue; destroying the queue flushes it and waits.
+class WriteQueue : public QObject
+{
+    Q_OBJECT
+public:
+    explicit WriteQueue(AsyncDatabase &db, int maxBatchSize = 256, int maxDelayMs = 5,
+                        QObject *parent = nullptr);
+    ~WriteQueue();
+
+    // Resolves to the new row id, or -1 if the transaction was rejected.
+    QFuture<int> addTransaction(const Transaction &tx);
+    // Hands over whatever is queued now instead of waiting for the delay.
+    void flush();
+
+    WriteQueueStats stats() const;
+
+private:
+    struct Item {
+        Transaction tx;
+        QFutureInterface<int> promise;
+        qint64 enqueuedNs;
+    };
+
+    void commitBatch(Database &db, QList<Item> &batch);
+
+    AsyncDatabase &db;
+    const int maxBatchSize;
+    const int maxDelayMs;
+    QTimer delayTimer;
+    QElapsedTimer clock;
+    mutable QMutex mutex;
+    QList<Item> pending;
+    QFuture<bool> lastBatch;
+    WriteQueueStats counters;
+};
+
+#endif // WRITEQUEUE_H